@@ -18,34 +18,158 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 //
-// analyze.c - analyze signal coming out of the channel; reads in .raw file
+// analyze.c - analyze signal coming out of the channel; reads in .raw file, or
+//             a qam -out bin file that is run through the in-process channel model
 //
 #include <cstdint>
 #include <string>
 #include <cmath>
 #include <iostream>
 #include <iomanip>
-#include <fstream>
 #include <sstream>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <map>
+#include <charconv>
+#include <cstring>
 #include "stdlib.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "real.h"
+#include "qam.h"
+#include "channel.h"
+#include "perf.h"
+#include "ber.h"
 
 static constexpr bool     debug              = false;
 
 // config constants
-static constexpr uint32_t VLEVEL_CNT         = 4;   // number of voltage levels
+static constexpr uint32_t VLEVEL_CNT_DEFAULT = 4;   // number of voltage levels (PAM4, for 16-QAM) unless -qam or a qam -out bin header says otherwise
 static constexpr double   TX_CLK_GHZ         = 20;  // TX symbol transfer rate 
 static constexpr double   RX_CLK_GHZ         = 100; // RX sample rate
 static constexpr double   TX_mV_MAX          = 400; // 200 mV max for Tx source
 static constexpr double   NOISE_mV_MAX       = 33;  // 33 mV max noise (our margins must be above this)
+static constexpr double   HI_LO_ADJUST_STEP  = 1.0; // default mV step between Vt_HIGH/Vt_LOW adjustments tried
+static constexpr uint32_t HIST_VERIFY_CNT    = 16;  // -opt hist: number of best estimates re-scored exactly
+static constexpr uint32_t HIST_BIN_CNT_MAX   = 4096;// -opt hist: max bins per histogram axis (bins get wider than -step beyond this)
+static constexpr double   ADAPT_DITHER_mV    = 4.0; // -opt adapt: offset of the shadow slicers from the current Vt adjustments
+static constexpr uint32_t ADAPT_WINDOW_UI    = 16;  // -opt adapt: UIs between Vt adjustment updates
+static constexpr int32_t  ADAPT_CDR_VOTES    = 16;  // -opt adapt: net early/late votes that move the sampling phase one RX sample
+static constexpr int32_t  ADAPT_CDR_DECAY    = 4;   // -opt adapt: every ADAPT_WINDOW_UI UIs, the net votes lose 1/ADAPT_CDR_DECAY of themselves
+static constexpr double   ADAPT_LOCK_mV      = 2.0; // -opt adapt: locked once the phase stops moving and the Vt adjustments stay this close to their final values
+static constexpr uint32_t EYE_T_BIN_CNT      = 64;  // -eye: time bins per UI
+static constexpr uint32_t EYE_V_BIN_CNT      = 512; // -eye: voltage bins
+static constexpr uint32_t EYE_SKIP_UI_CNT    = 2;   // -eye: start-up UIs left out
+static constexpr double   STAT_BIN_mV        = 0.5; // -stat: margin histogram bin width
+static constexpr double   STAT_TAIL_FRAC     = 0.05;// -stat: fraction of each margin histogram (its low end) fit as a Gaussian tail
+static constexpr uint32_t STAT_TAIL_MIN_CNT  = 3;   // -stat: fewest bin edges fit, even if that takes more than STAT_TAIL_FRAC
+static constexpr double   STAT_VT_STEP_mV    = 2.0; // -stat: threshold offsets in the threshold bathtub
 
 // derived constants
 static constexpr double   TX_CLK_PERIOD_PS   = 1000.0 / TX_CLK_GHZ;
 static constexpr double   RX_CLK_PERIOD_PS   = 1000.0 / RX_CLK_GHZ;
 static constexpr double   RX_mV_MAX          = TX_mV_MAX/2; 
-static constexpr double   Vt_HIGH            = RX_mV_MAX * 2.0 / 3.0;
-static constexpr double   Vt_MID             = 0.0;
-static constexpr double   Vt_LOW             = -Vt_HIGH;
+static constexpr double   EYE_T_BIN_PS       = TX_CLK_PERIOD_PS / double(EYE_T_BIN_CNT);
+static constexpr double   EYE_mV_MAX         = 2.0*RX_mV_MAX;   // voltage bins cover +/- this (RX overshoots RX_mV_MAX)
+static constexpr double   EYE_V_BIN_mV       = 2.0*EYE_mV_MAX / double(EYE_V_BIN_CNT);
+static constexpr double   STAT_MARGIN_mV_MAX = EYE_mV_MAX + RX_mV_MAX;      // margin bins cover +/- this
+static constexpr uint32_t STAT_BIN_CNT       = uint32_t(2.0*STAT_MARGIN_mV_MAX / STAT_BIN_mV);
+
+// Nominal threshold between levels k-1 and k of VLEVEL_CNT levels.
+// For PAM4 these are Vt_LOW, Vt_MID and Vt_HIGH.
+template<uint32_t VLEVEL_CNT>
+constexpr double vt_nominal( uint32_t k )
+{
+    return double(int(2*k) - int(VLEVEL_CNT)) * RX_mV_MAX / double(VLEVEL_CNT-1);
+}
+
+// Fraction of the static Vt adjustment applied to threshold k: 1 at the top, 
+// -1 at the bottom, 0 in the middle (and for PAM2's single threshold).
+template<uint32_t VLEVEL_CNT>
+constexpr double vt_static_frac( uint32_t k )
+{
+    return (VLEVEL_CNT == 2) ? 0.0 : double(int(2*k) - int(VLEVEL_CNT)) / double(VLEVEL_CNT-2);
+}
+
+// Largest Vt adjustment tried: a quarter of the spacing between levels.
+inline double hi_lo_adjust_max( uint32_t vlevel_cnt )
+{
+    return double(2) * RX_mV_MAX / double(vlevel_cnt-1) / 4;
+}
+
+// runtime options
+static uint32_t vlevel_cnt = 0;                  // -qam <N>: sqrt(N) levels; 0 means from the input (see main())
+static uint32_t thread_cnt = 0;                  // 0 means use std::thread::hardware_concurrency()
+static bool     opt_hist   = false;              // -opt hist: histogram optimizer instead of brute-force grid
+static bool     opt_adapt  = false;              // -opt adapt: one-pass adaptive receiver instead of a search
+static double   hi_lo_adjust_step = HI_LO_ADJUST_STEP;
+static bool     interp_cubic = false;            // -interp cubic: 4-point Lagrange RX interpolation instead of linear
+static double   hi_lo_adjust_range = 0.0;       // -adjust_max: largest Vt adjustment tried (0 means hi_lo_adjust_max())
+static uint32_t hi_lo_adjust_cnt  = 0;           // derived from hi_lo_adjust_step in main()
+static size_t   rx_window  = 0;                  // -window: keep only the last rx_window RX samples (0 means all)
+static bool     use_batch_slicer = !debug;       // -slicer batch|scalar (scalar prints per-sample debug info)
+static double   channel_len_m    = 0.010;        // -channel_len: line length of the channel model (qam -out bin input)
+static std::string channel_step_file = "";       // -channel_step: SPICE step characterization to use instead of the line model
+static std::string eye_file  = "";               // -eye: write the eye diagram here (.pgm for an image)
+static Perf        perf;                         // -perf <json_file>: per-phase timing
+static std::string perf_file = "";
+static std::string cache_dir = "";               // -cache: directory of cached RX samples and sweep results
+static bool        stat_eye  = false;            // -stat: also print BER bathtubs extrapolated from the margin tails
+
+struct Entry
+{
+    int64_t index;
+    double  time_ps;
+    double  iq_tx_mv;
+    double  iq_rx_mv;
+};
+
+// RX samples at one sample rate and phase (-rx_ghz).
+// Only the voltages as the ADC sees them are kept, in real_store (see real.h); 
+// the time of each is implied by its index, and its slicer decision is 
+// made again when needed.  That is 2 to 8 bytes per RX sample.
+struct RxStream
+{
+    double   ghz;
+    double   phase_ps;                  // time of the first RX sample
+    double   period_ps;
+    uint32_t stride;                    // RX samples per UI
+    double   time_ps;                   // next RX sample time while sampling
+    uint64_t cache_key;                 // -cache
+    uint64_t first_i;                   // RX samples before mv[0] that fell out of the -window
+    std::vector<real_store> mv;
+
+    // time at which mv[i] was sampled (the ADC's output time, one period later)
+    double sample_time_ps( size_t i ) const { return phase_ps + double(first_i + i + 1) * period_ps; }
+};
+
+static std::vector<RxStream> rx_streams;         // -rx_ghz <ghz>[@<phase_ps>],...: RX sample rates (default RX_CLK_GHZ)
+
+// result of one (static_hi_lo_adjust, dynamic_hi_lo_adjust, rx_offset) grid point;
+// pct < 0 means the grid point was not scored
+struct SweepResult
+{
+    uint32_t cnt;
+    uint32_t above_noise_cnt;
+    double   pct;
+};
+
+// -opt hist: 2D cumulative histogram of (sample mV, previous RX sample mV) 
+// for the chosen samples of one (rx_offset, prev chosen bits) group
+struct HistGroup
+{
+    std::vector<double>   mv;           // chosen sample voltages
+    std::vector<double>   prev_mv;      // voltage of the RX sample before each one
+    double                lo_mv;        // low edge of bin 1
+    double                bin_mv;       // bin width
+    uint32_t              bin_cnt;      // bins per axis, numbered 1 .. bin_cnt
+    std::vector<uint32_t> cum;          // (bin_cnt+1)^2 counts of pairs with mv bin <= i and prev_mv bin <= j
+};
 
 void die( std::string msg )
 {
@@ -53,221 +177,1648 @@ void die( std::string msg )
     exit( 1 );
 }
 
-void parse_skip_whitespace( std::string s, size_t& pos )
+RxStream rx_stream( double ghz, double phase_ps )
 {
-    size_t len = s.length();
-    while( pos < len ) 
+    double stride = ghz / TX_CLK_GHZ;
+    if ( !(stride >= 1.0) || stride != std::floor( stride ) ) die( "each -rx_ghz rate must be a multiple of the TX rate" );
+    return RxStream{ ghz, phase_ps, 1000.0 / ghz, uint32_t(stride), 0.0, 0, 0, std::vector<real_store>() };
+}
+
+//------------------------------------------------------------------
+// Reader for the transient plot of an ngspice .raw file, ASCII or binary.
+// The file is mmap'd and values are decoded directly out of the mapping:
+// binary values are loaded in place and ASCII values go through std::from_chars,
+// so nothing is copied into std::strings.
+//
+// ASCII values are parsed as double; the original reader rounded them to float
+// with std::stof.  With the original swapped linear interpolation weights, 
+// that difference was enough to move the best grid point on some waveforms.
+// With correct interpolation it only shifts individual sample counts.
+//------------------------------------------------------------------
+class RawFile
+{
+public:
+    RawFile( std::string path );
+    ~RawFile();
+
+    bool next( Entry& entry );                  // returns false after the last point
+
+private:
+    const char * data;
+    size_t       size;
+    const char * pos;                           // current position in data
+    const char * end;                           // data + size
+    bool         is_binary;
+    bool         is_complex;
+    uint32_t     var_cnt;
+    int64_t      point_cnt;
+    int64_t      point_i;
+    uint32_t     time_var;
+    uint32_t     iq_tx_var;
+    uint32_t     iq_rx_var;
+
+    std::string  header_line( void );
+    bool         skip_whitespace( void );
+    bool         skip_token( void );
+    double       parse_value( void );
+};
+
+RawFile::RawFile( std::string path )
+{
+    int fd = open( path.c_str(), O_RDONLY );
+    if ( fd < 0 ) die( "could not open raw file " + path );
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 ) die( "could not stat raw file " + path );
+    size = st.st_size;
+    void * m = (size == 0) ? MAP_FAILED : mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( m == MAP_FAILED ) die( "could not mmap raw file " + path );
+    madvise( m, size, MADV_SEQUENTIAL );
+    data = static_cast<const char *>( m );
+    pos  = data;
+    end  = data + size;
+
+    //------------------------------------------------------------------
+    // Walk the plot headers until we find the transient analysis, 
+    // skipping the values of any other plots (e.g., the .OP plot).
+    //------------------------------------------------------------------
+    for( ;; )
     {
-        char c = s.at( pos );
-        if ( c != ' ' && c != '\t' && c != '\n' ) break;
-        pos++;
+        bool is_tran = false;
+        is_complex = false;
+        var_cnt    = 0;
+        point_cnt  = 0;
+        time_var   = 0;
+        iq_tx_var  = 3;                         // v(iq_clk) in the usual out2sp .save order
+        iq_rx_var  = 4;                         // v(iq_clk_rx)
+        for( ;; )
+        {
+            if ( pos >= end ) die( "no transient analysis values in raw file " + path );
+            std::string s = header_line();
+            if ( s.compare( 0, 9, "Plotname:" ) == 0 ) {
+                is_tran = s.find( "Transient" ) != std::string::npos || s.find( "transient" ) != std::string::npos;
+            } else if ( s.compare( 0, 6, "Flags:" ) == 0 ) {
+                is_complex = s.find( "complex" ) != std::string::npos;
+            } else if ( s.compare( 0, 14, "No. Variables:" ) == 0 ) {
+                var_cnt = std::atoi( s.c_str() + 14 );
+            } else if ( s.compare( 0, 11, "No. Points:" ) == 0 ) {
+                point_cnt = std::atoll( s.c_str() + 11 );
+            } else if ( s.compare( 0, 10, "Variables:" ) == 0 ) {
+                for( uint32_t v = 0; v < var_cnt; v++ )
+                {
+                    std::istringstream vs( header_line() );
+                    uint32_t    i;
+                    std::string name;
+                    if ( !(vs >> i >> name) ) die( "bad variable line in raw file " + path );
+                    for( auto& c : name ) c = std::tolower( c );
+                    if ( name == "time" )         time_var  = i;
+                    if ( name == "v(iq_clk)" )    iq_tx_var = i;
+                    if ( name == "v(iq_clk_rx)" ) iq_rx_var = i;
+                }
+            } else if ( s.compare( 0, 7, "Values:" ) == 0 || s.compare( 0, 7, "Binary:" ) == 0 ) {
+                is_binary = s[0] == 'B';
+                break;
+            }
+        }
+        if ( iq_tx_var >= var_cnt || iq_rx_var >= var_cnt ) die( "raw file " + path + " does not have iq_tx and iq_rx values" );
+
+        if ( is_binary ) {
+            size_t point_size = size_t(var_cnt) * (is_complex ? 16 : 8);
+            size_t avail_cnt  = (end - pos) / point_size;
+            if ( point_cnt < 0 || size_t(point_cnt) > avail_cnt ) point_cnt = avail_cnt;
+            if ( is_tran ) break;
+            pos += point_cnt * point_size;
+        } else {
+            if ( is_tran ) break;
+            for( int64_t i = 0; i < point_cnt*(1 + var_cnt); i++ ) 
+            {
+                if ( !skip_token() ) die( "truncated values in raw file " + path );
+            }
+        }
     }
+    point_i = 0;
 }
 
-std::string parse_non_whitespace( std::string s, size_t& pos )
+RawFile::~RawFile()
 {
-    parse_skip_whitespace( s, pos );
-    size_t len = s.length();
-    size_t pos_first = pos;
-    std::string nw = "";
-    while( pos < len ) 
+    munmap( const_cast<char *>( data ), size );
+}
+
+std::string RawFile::header_line( void )
+{
+    const char * eol = static_cast<const char *>( std::memchr( pos, '\n', end - pos ) );
+    if ( eol == nullptr ) eol = end;
+    std::string s( pos, eol - pos );
+    pos = (eol == end) ? end : (eol + 1);
+    return s;
+}
+
+bool RawFile::skip_whitespace( void )
+{
+    while( pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r') ) pos++;
+    return pos < end;
+}
+
+bool RawFile::skip_token( void )
+{
+    if ( !skip_whitespace() ) return false;
+    while( pos < end && *pos != ' ' && *pos != '\t' && *pos != '\n' && *pos != '\r' ) pos++;
+    return true;
+}
+
+double RawFile::parse_value( void )
+{
+    if ( !skip_whitespace() ) die( "truncated entry at end of file" );
+    double v;
+    auto r = std::from_chars( pos, end, v );
+    if ( r.ec != std::errc() ) die( "bad value in raw file: " + std::string( pos, std::min<size_t>( end - pos, 32 ) ) );
+    pos = r.ptr;
+    while( pos < end && *pos != ' ' && *pos != '\t' && *pos != '\n' && *pos != '\r' ) pos++;  // ",imag" of a complex value
+    return v;
+}
+
+bool RawFile::next( Entry& entry )
+{
+    if ( point_i >= point_cnt ) return false;
+    double time = 0.0;
+    double iq_tx = 0.0;
+    double iq_rx = 0.0;
+    if ( is_binary ) {
+        const size_t value_size = is_complex ? 16 : 8;
+        std::memcpy( &time,  pos + time_var *value_size, 8 );
+        std::memcpy( &iq_tx, pos + iq_tx_var*value_size, 8 );
+        std::memcpy( &iq_rx, pos + iq_rx_var*value_size, 8 );
+        pos += var_cnt * value_size;
+        entry.index = point_i;
+    } else {
+        if ( !skip_whitespace() ) return false;
+        auto r = std::from_chars( pos, end, entry.index );
+        if ( r.ec != std::errc() ) return false;  // start of another plot
+        pos = r.ptr;
+        for( uint32_t v = 0; v < var_cnt; v++ )
+        {
+            double value = parse_value();
+            if ( v == time_var )  time  = value;
+            if ( v == iq_tx_var ) iq_tx = value;
+            if ( v == iq_rx_var ) iq_rx = value;
+        }
+    }
+    entry.time_ps  = time  * 1.0e12;
+    entry.iq_tx_mv = iq_tx *  500.0;            // in RX terms
+    entry.iq_rx_mv = iq_rx * 1000.0;
+    point_i++;
+    return true;
+}
+
+double lerp( double f1, const double f2, const double a )
+{
+    return a*f1 + (1.0 - a)*f2;
+}
+
+//------------------------------------------------------------------
+// Source of Entry values for a qam -out bin file.
+// The TX waveform is rebuilt from the symbols with waves<N_SQRT>() for the 
+// QAM order in the file header and the RX waveform is the output of the 
+// Channel, so there is no SPICE run or .raw file.
+// Entries are on the waveform's TIMESTEP_PS grid, starting with 0 mV at time 0 
+// as in the SPICE deck.  The source drives twice the waveform mV (see out2sp).
+//------------------------------------------------------------------
+static constexpr uint32_t QAM_SOURCE_CLK_CNT = 1024;   // clocks of waveform generated at a time
+
+// Append the source waveform of syms[first..last) to src_mv.
+template<uint32_t N_SQRT>
+void qam_source_mv( const std::vector<uint8_t>& syms, size_t first, size_t last, uint32_t& Q_level_prev, std::vector<double>& src_mv )
+{
+    const WaveTable<N_SQRT>& wave_table = waves<N_SQRT>();
+    for( size_t clk_i = first; clk_i < last; clk_i++ )
     {
-        char c = s.at( pos );
-        if ( c == ' ' || c == '\t' || c == '\n' ) break;
-        nw += c;
-        pos++;
+        uint32_t bits    = syms[clk_i];
+        uint32_t Q_level = Q_level_of<N_SQRT>( bits );
+        const ClkWave& w = wave_table.wave[Q_level_prev][I_level_of<N_SQRT>( bits )][Q_level];
+        for( uint32_t ts = 0; ts < CLK_TIMESTEP_CNT; ts++ ) src_mv.push_back( 2.0 * double(w.IQ_mV[ts]) );
+        Q_level_prev = Q_level;
     }
-    if ( nw == "" ) {
-        std::cout << "ERROR: expected non-whitespace, got nothing more on this line starting at pos=" << pos_first << ": " << s << "\n";
-        exit( 1 );
+}
+
+class QamBinSource
+{
+public:
+    QamBinSource( std::string path, Channel& channel );
+
+    bool next( Entry& entry );                  // returns false after the last point
+    uint32_t level_cnt( void ) const { return n_sqrt; }    // levels per I and Q
+
+private:
+    Channel&             channel;
+    std::vector<uint8_t> syms;
+    uint32_t             n_sqrt;
+    uint32_t             Q_level_prev;
+    void              (* source_mv)( const std::vector<uint8_t>&, size_t, size_t, uint32_t&, std::vector<double>& );
+    size_t               clk_i;                 // next clock to generate
+    bool                 finished;              // channel.finish() was called
+    std::vector<double>  src_mv;                // source waveform not yet returned
+    std::vector<double>  rx_mv;                 // channel output for the start of src_mv
+    size_t               i;                     // next index into src_mv and rx_mv
+    int64_t              index;
+};
+
+QamBinSource::QamBinSource( std::string path, Channel& channel_ ) : channel( channel_ )
+{
+    std::string err = read_qam_bin( path, syms, n_sqrt, Q_level_prev );
+    if ( err != "" ) die( err );
+    qam_dispatch( n_sqrt, [&]( auto n ) { source_mv = qam_source_mv<decltype(n)::value>; } );
+    clk_i    = 0;
+    finished = false;
+    i        = 0;
+    index    = 0;
+    src_mv.push_back( 0.0 );
+    channel.push( src_mv.data(), 1, rx_mv );
+}
+
+bool QamBinSource::next( Entry& entry )
+{
+    while( i == rx_mv.size() )
+    {
+        src_mv.erase( src_mv.begin(), src_mv.begin() + i );
+        rx_mv.clear();
+        i = 0;
+        if ( clk_i < syms.size() ) {
+            size_t first = src_mv.size();
+            size_t last_clk_i = std::min( clk_i + QAM_SOURCE_CLK_CNT, syms.size() );
+            source_mv( syms, clk_i, last_clk_i, Q_level_prev, src_mv );
+            clk_i = last_clk_i;
+            channel.push( src_mv.data() + first, src_mv.size() - first, rx_mv );
+        } else if ( !finished ) {
+            channel.finish( rx_mv );
+            finished = true;
+        } else {
+            return false;
+        }
     }
-    return nw;
+    entry.index    = index;
+    entry.time_ps  = double(index) * TIMESTEP_PS;
+    entry.iq_tx_mv = src_mv[i] * 0.5;           // in RX terms
+    entry.iq_rx_mv = rx_mv[i];
+    index++;
+    i++;
+    return true;
 }
 
-int64_t parse_int( std::string s, size_t& pos )
+//------------------------------------------------------------------
+// Channel for qam -out bin input: the line model, or the step response 
+// in channel_step_file resampled to TIMESTEP_PS.  The step file is a SPICE 
+// run of the out2sp deck with a constant source (a step at time 0) on IQ_clk.
+//------------------------------------------------------------------
+Channel make_channel( void )
 {
-    std::string i_s = parse_non_whitespace( s, pos );
-    return std::stoi( i_s );
+    if ( channel_step_file == "" ) {
+        LineModel model;
+        model.len_m = channel_len_m;
+        return Channel( TIMESTEP_PS, model );
+    }
+
+    RawFile raw( channel_step_file );
+    Entry entry_prev{ -1, 0.0, 0.0, 0.0 };
+    Entry entry;
+    double src_mv = 0.0;
+    double time_ps = 0.0;
+    std::vector<double> step;
+    while( raw.next( entry ) && step.size() < CHANNEL_TAP_CNT_MAX )
+    {
+        src_mv = 2.0 * entry.iq_tx_mv;
+        while( entry.time_ps >= time_ps && step.size() < CHANNEL_TAP_CNT_MAX ) 
+        {
+            double a = (entry.time_ps == entry_prev.time_ps) ? 1.0 : (time_ps - entry_prev.time_ps) / (entry.time_ps - entry_prev.time_ps);
+            step.push_back( lerp( entry.iq_rx_mv, entry_prev.iq_rx_mv, a ) );
+            time_ps += TIMESTEP_PS;
+        }
+        entry_prev = entry;
+    }
+    if ( step.empty() || std::fabs( src_mv ) < 1.0 ) die( channel_step_file + " does not have a step on v(iq_clk)" );
+    for( auto& v : step ) v /= src_mv;
+    return Channel( step );
 }
 
-double parse_flt( std::string s, size_t& pos )
+bool is_qam_bin( std::string path )
 {
-    std::string f_s = parse_non_whitespace( s, pos );
-    return std::stof( f_s );
+    std::ifstream in( path, std::ios::binary );
+    char magic[4];
+    return in.read( magic, 4 ) && std::string( magic, 4 ) == "QAMW";
 }
 
-double lerp( double f1, const double f2, const double a )
+//------------------------------------------------------------------
+// Result cache (-cache <dir>).
+//
+// The RX samples of an input are cached under a key that hashes the input file's 
+// contents and every setting that affects the samples, so a repeated analysis 
+// skips parsing and resampling.  The sweep results are cached under a key that 
+// adds the sweep settings, one record per (static, dynamic) adjustment pair, so 
+// a repeated, finer (-step) or wider (-adjust_max) grid only runs the pairs 
+// it has not seen.  Files are <dir>/<key>.samples and <dir>/<key>.scores.
+//
+// Only the grid optimizer's results are cached; -opt hist still reuses the samples.
+// -eye needs the whole waveform, so it always resamples (and refreshes the samples).
+//------------------------------------------------------------------
+static constexpr uint32_t CACHE_VERSION = 4;
+
+// 64-bit hash, 4 lanes of 8 bytes at a time
+inline uint64_t hash_mix( uint64_t h )
 {
-    return a*f1 + (1.0 - a)*f2;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
 }
 
-int pam4( double mV, double& vt, double& margin, double static_hi_lo_adjust=0.0, int prev_bits=0, double dynamic_hi_lo_adjust=0.0 )
+uint64_t hash64( const void * data, size_t size, uint64_t seed )
 {
-    double vt_high_for_above = Vt_HIGH - static_hi_lo_adjust - ((prev_bits <= 2) ? dynamic_hi_lo_adjust : 0);
-    double vt_high_for_below = Vt_HIGH - static_hi_lo_adjust;
-    double vt_mid_for_above  = Vt_MID                        - ((prev_bits <= 1) ? dynamic_hi_lo_adjust : 0);
-    double vt_mid_for_below  = Vt_MID                        + ((prev_bits >= 2) ? dynamic_hi_lo_adjust : 0);
-    double vt_low_for_above  = Vt_LOW  + static_hi_lo_adjust;
-    double vt_low_for_below  = Vt_LOW  + static_hi_lo_adjust + ((prev_bits >= 1) ? dynamic_hi_lo_adjust : 0);
-    if ( mV > vt_high_for_above ) {
-        vt     = vt_high_for_above;
-        margin = mV - vt;
-        return 0b11;
-    } else if ( mV < vt_high_for_below && mV > vt_mid_for_above ) {
-        vt     = vt_mid_for_above;
-        margin = mV - vt;
-        if ( (vt_high_for_below-mV) < margin ) {
-            vt     = vt_high_for_below;
-            margin = vt - mV;
+    const char * p = static_cast<const char *>( data );
+    uint64_t h[4] = { seed, seed ^ 0x9e3779b97f4a7c15ULL, seed ^ 0x3c6ef372fe94f82aULL, seed ^ 0xdaa66d2c7ddf743fULL };
+    size_t i = 0;
+    for( ; (i + 32) <= size; i += 32 )
+    {
+        for( uint32_t l = 0; l < 4; l++ )
+        {
+            uint64_t w;
+            std::memcpy( &w, p + i + 8*l, 8 );
+            h[l] = hash_mix( h[l] ^ w );
         }
-        return 0b10;
-    } else if ( mV > vt_low_for_above  && mV < vt_mid_for_below ) {
-        vt     = vt_low_for_above;
-        margin = mV - vt;
-        if ( (vt_mid_for_below-mV) < margin ) {
-            vt     = vt_mid_for_below;
-            margin = vt - mV;
+    }
+    uint64_t tail = 0;
+    for( uint32_t k = 0; i < size; i++, k++ ) tail = hash_mix( tail ^ (uint64_t(uint8_t(p[i])) << (8*(k & 7))) );
+    return hash_mix( h[0] ^ hash_mix( h[1] ^ hash_mix( h[2] ^ hash_mix( h[3] ^ tail ^ size ) ) ) );
+}
+
+uint64_t hash_file( std::string path, uint64_t seed )
+{
+    int fd = open( path.c_str(), O_RDONLY );
+    if ( fd < 0 ) die( "could not open " + path );
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 ) die( "could not stat " + path );
+    size_t size = st.st_size;
+    void * m = (size == 0) ? nullptr : mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( m == MAP_FAILED ) die( "could not mmap " + path );
+    if ( m != nullptr ) madvise( m, size, MADV_SEQUENTIAL );
+    uint64_t h = hash64( m, size, seed );
+    if ( m != nullptr ) munmap( m, size );
+    return h;
+}
+
+std::string cache_path( uint64_t key, std::string ext )
+{
+    char buf[32];
+    snprintf( buf, sizeof( buf ), "%016llx", static_cast<unsigned long long>( key ) );
+    return cache_dir + "/" + buf + ext;
+}
+
+// key of one stream's RX samples of a file with the given hash_file( raw_file, 0 ) as sampled with the current settings
+uint64_t samples_cache_key( uint64_t raw_file_hash, const RxStream& stream )
+{
+    std::ostringstream config;
+    config << std::setprecision( 17 ) << "samples v" << CACHE_VERSION << " real " << sizeof( real ) << " " << real(0.1) << " " << sizeof( real_store )
+           << " levels " << vlevel_cnt << " window " << rx_window << " tx_ghz " << TX_CLK_GHZ 
+           << " rx_ghz " << stream.ghz << " phase " << stream.phase_ps << " cubic " << interp_cubic
+           << " channel_len " << channel_len_m << " channel_step " << ((channel_step_file != "") ? hash_file( channel_step_file, 0 ) : 0);
+    std::string c = config.str();
+    return hash64( c.data(), c.size(), raw_file_hash );
+}
+
+// returns false if there is no usable cache file
+bool load_samples( uint64_t key, RxStream& stream, uint32_t& level_cnt )
+{
+    std::ifstream in( cache_path( key, ".samples" ), std::ios::binary );
+    char     magic[4];
+    uint32_t version;
+    uint64_t cnt;
+    if ( !in.read( magic, 4 ) || std::string( magic, 4 ) != "QAMS" || !read_bin( in, version ) || version != CACHE_VERSION ||
+         !read_bin( in, level_cnt ) || !qam_order_ok( level_cnt ) || !read_bin( in, stream.first_i ) || !read_bin( in, cnt ) ) return false;
+    stream.mv.resize( cnt );
+    return bool( in.read( reinterpret_cast<char *>( stream.mv.data() ), cnt * sizeof( real_store ) ) );
+}
+
+void save_samples( uint64_t key, const RxStream& stream, uint32_t level_cnt )
+{
+    mkdir( cache_dir.c_str(), 0777 );
+    std::string path = cache_path( key, ".samples" );
+    std::ofstream out( path, std::ios::binary );
+    out.write( "QAMS", 4 );
+    write_bin( out, CACHE_VERSION );
+    write_bin( out, level_cnt );
+    write_bin( out, stream.first_i );
+    write_bin( out, uint64_t(stream.mv.size()) );
+    out.write( reinterpret_cast<const char *>( stream.mv.data() ), stream.mv.size() * sizeof( real_store ) );
+    if ( !out ) die( "could not write " + path );
+}
+
+//------------------------------------------------------------------
+// Sweep results of one set of samples and sweep settings, by (static, dynamic) pair.
+// New pairs are appended to the file as they are added.
+//------------------------------------------------------------------
+class ScoreCache
+{
+public:
+    ScoreCache( uint64_t samples_key, uint32_t rx_stride );
+
+    bool find( double static_hi_lo_adjust, double dynamic_hi_lo_adjust, SweepResult * results ) const;  // rx_stride results
+    void add( double static_hi_lo_adjust, double dynamic_hi_lo_adjust, const SweepResult * results );
+
+private:
+    uint32_t      rx_stride;
+    std::string   path;
+    std::ofstream out;
+    std::map<std::pair<double, double>, std::vector<SweepResult>> scores;
+};
+
+ScoreCache::ScoreCache( uint64_t samples_key, uint32_t rx_stride_ ) : rx_stride( rx_stride_ )
+{
+    std::ostringstream config;
+    config << std::setprecision( 17 ) << "scores v" << CACHE_VERSION << " rx_stride " << rx_stride << " noise " << NOISE_mV_MAX;
+    std::string c = config.str();
+    path = cache_path( hash64( c.data(), c.size(), samples_key ), ".scores" );
+
+    std::ifstream in( path, std::ios::binary );
+    char magic[4];
+    uint32_t version;
+    bool ok = in.read( magic, 4 ) && std::string( magic, 4 ) == "QAMC" && read_bin( in, version ) && version == CACHE_VERSION;
+    double adjusts[2];
+    std::vector<SweepResult> results( rx_stride );
+    while( ok && read_bin( in, adjusts ) && in.read( reinterpret_cast<char *>( results.data() ), rx_stride * sizeof( SweepResult ) ) )
+    {
+        scores[{ adjusts[0], adjusts[1] }] = results;
+    }
+    in.close();
+
+    mkdir( cache_dir.c_str(), 0777 );
+    out.open( path, std::ios::binary | (ok ? std::ios::app : std::ios::trunc) );
+    if ( !ok ) {
+        out.write( "QAMC", 4 );
+        write_bin( out, CACHE_VERSION );
+    }
+    if ( !out ) die( "could not write " + path );
+}
+
+bool ScoreCache::find( double static_hi_lo_adjust, double dynamic_hi_lo_adjust, SweepResult * results ) const
+{
+    auto it = scores.find( { static_hi_lo_adjust, dynamic_hi_lo_adjust } );
+    if ( it == scores.end() ) return false;
+    std::copy( it->second.begin(), it->second.end(), results );
+    return true;
+}
+
+void ScoreCache::add( double static_hi_lo_adjust, double dynamic_hi_lo_adjust, const SweepResult * results )
+{
+    double adjusts[2] = { static_hi_lo_adjust, dynamic_hi_lo_adjust };
+    write_bin( out, adjusts );
+    out.write( reinterpret_cast<const char *>( results ), rx_stride * sizeof( SweepResult ) );
+    scores[{ static_hi_lo_adjust, dynamic_hi_lo_adjust }].assign( results, results + rx_stride );
+}
+
+//------------------------------------------------------------------
+// Eye diagram: a 2D histogram of RX voltage vs. time within the UI, i.e., the 
+// RX waveform folded at TX_CLK_PERIOD_PS.  sample_rx() fills it during its one 
+// pass at EYE_T_BIN_CNT evenly spaced times per UI.  Counts are stored one 
+// time column after another, so consecutive adds touch neighboring columns and 
+// the whole table (128 KiB) stays cache-resident however big the input is.
+//
+// Each eye opening (between RX levels k-1 and k) is measured as:
+//
+//   height: the tallest run of empty voltage bins between the two levels in any time column
+//   width:  the run of time columns, wrapping around the UI, in which the voltage bin 
+//           at the center of that tallest run stays empty
+//------------------------------------------------------------------
+struct EyeOpening
+{
+    double height_mv;
+    double width_ps;
+    double center_mv;                   // voltage and time at the center of the tallest run
+    double center_ps;
+};
+
+class EyeDiagram
+{
+public:
+    EyeDiagram( void ) : cnt( size_t(EYE_T_BIN_CNT) * EYE_V_BIN_CNT, 0 ) {}
+
+    inline void add( uint32_t t_bin, double mv ) { cnt[size_t(t_bin)*EYE_V_BIN_CNT + v_bin( mv )]++; }
+
+    std::vector<EyeOpening> openings( uint32_t level_cnt ) const;
+    void write( std::string path, const std::vector<EyeOpening>& openings ) const;
+
+private:
+    std::vector<uint32_t> cnt;          // [t_bin][v_bin]
+
+    static inline uint32_t v_bin( double mv )
+    {
+        double f = std::floor( (mv + EYE_mV_MAX) / EYE_V_BIN_mV );
+        return (f <= 0.0) ? 0 : (f >= double(EYE_V_BIN_CNT-1)) ? (EYE_V_BIN_CNT-1) : uint32_t(f);
+    }
+    inline uint32_t at( uint32_t t, uint32_t v ) const { return cnt[size_t(t)*EYE_V_BIN_CNT + v]; }
+};
+
+std::vector<EyeOpening> EyeDiagram::openings( uint32_t level_cnt ) const
+{
+    auto level_mv = [&]( uint32_t l ) { return double(int(2*l) - int(level_cnt-1)) * RX_mV_MAX / double(level_cnt-1); };
+    std::vector<EyeOpening> eyes;
+    for( uint32_t k = 1; k < level_cnt; k++ )
+    {
+        const uint32_t lo = v_bin( level_mv( k-1 ) ) + 1;
+        const uint32_t hi = v_bin( level_mv( k ) );
+
+        // tallest empty run
+        uint32_t best_len = 0;
+        uint32_t best_t   = 0;
+        uint32_t best_v   = 0;
+        for( uint32_t t = 0; t < EYE_T_BIN_CNT; t++ )
+        {
+            uint32_t len = 0;
+            for( uint32_t v = lo; v < hi; v++ )
+            {
+                len = (at( t, v ) == 0) ? (len+1) : 0;
+                if ( len > best_len ) {
+                    best_len = len;
+                    best_t   = t;
+                    best_v   = v + 1 - (len+1)/2;   // center bin of the run
+                }
+            }
+        }
+
+        EyeOpening eye{ 0.0, 0.0, (level_mv( k-1 ) + level_mv( k )) / 2.0, 0.0 };
+        if ( best_len != 0 ) {
+            uint32_t width = 1;
+            while( width < EYE_T_BIN_CNT && at( (best_t + width) % EYE_T_BIN_CNT, best_v ) == 0 ) width++;
+            uint32_t before = 0;
+            while( (width + before) < EYE_T_BIN_CNT && at( (best_t + EYE_T_BIN_CNT - 1 - before) % EYE_T_BIN_CNT, best_v ) == 0 ) before++;
+            eye.height_mv = double(best_len) * EYE_V_BIN_mV;
+            eye.width_ps  = double(width + before) * EYE_T_BIN_PS;
+            eye.center_mv = (double(best_v) + 0.5) * EYE_V_BIN_mV - EYE_mV_MAX;
+            eye.center_ps = (double(best_t) + 0.5) * EYE_T_BIN_PS;
+        }
+        eyes.push_back( eye );
+    }
+    return eyes;
+}
+
+//------------------------------------------------------------------
+// A path ending in .pgm gets an 8-bit image two UIs wide with log-scaled counts 
+// and the highest voltage at the top.  Anything else gets the binary layout 
+// (native byte order):
+//
+//     char     magic[4]            "EYED"
+//     uint32_t version             1
+//     uint32_t t_bin_cnt, v_bin_cnt
+//     double   ui_ps, v_lo_mv, v_bin_mv
+//     uint32_t opening_cnt
+//     double   height_mv, width_ps, center_mv, center_ps     per opening, lowest first
+//     uint32_t cnt[t_bin_cnt][v_bin_cnt]
+//------------------------------------------------------------------
+static constexpr uint32_t EYE_BIN_VERSION = 1;
+
+void EyeDiagram::write( std::string path, const std::vector<EyeOpening>& openings ) const
+{
+    std::ofstream out( path, std::ios::binary );
+    if ( !out.is_open() ) die( "unable to open " + path + " for output" );
+    if ( path.size() > 4 && path.compare( path.size()-4, 4, ".pgm" ) == 0 ) {
+        uint32_t cnt_max = 1;
+        for( auto c : cnt ) cnt_max = std::max( cnt_max, c );
+        out << "P5\n" << 2*EYE_T_BIN_CNT << " " << EYE_V_BIN_CNT << "\n255\n";
+        std::vector<uint8_t> row( 2*EYE_T_BIN_CNT );
+        for( uint32_t v = EYE_V_BIN_CNT; v-- > 0; )
+        {
+            for( uint32_t t = 0; t < 2*EYE_T_BIN_CNT; t++ ) 
+            {
+                row[t] = uint8_t( 255.0 * std::log1p( double(at( t % EYE_T_BIN_CNT, v )) ) / std::log1p( double(cnt_max) ) + 0.5 );
+            }
+            out.write( reinterpret_cast<const char *>( row.data() ), row.size() );
         }
-        return 0b01;
     } else {
-        vt     = vt_low_for_below;
-        margin = vt - mV;
-        return 0b00;
+        out.write( "EYED", 4 );
+        write_bin( out, EYE_BIN_VERSION );
+        write_bin( out, EYE_T_BIN_CNT );
+        write_bin( out, EYE_V_BIN_CNT );
+        write_bin( out, TX_CLK_PERIOD_PS );
+        write_bin( out, -EYE_mV_MAX );
+        write_bin( out, EYE_V_BIN_mV );
+        write_bin( out, uint32_t(openings.size()) );
+        for( const auto& eye : openings ) 
+        {
+            write_bin( out, eye.height_mv );
+            write_bin( out, eye.width_ps );
+            write_bin( out, eye.center_mv );
+            write_bin( out, eye.center_ps );
+        }
+        out.write( reinterpret_cast<const char *>( cnt.data() ), cnt.size() * sizeof( cnt[0] ) );
     }
+    if ( !out ) die( "unable to write " + path );
 }
 
-int main( int argc, const char * argv[] )
+//------------------------------------------------------------------
+// Thresholds that pam<VLEVEL_CNT>() uses for one set of Vt adjustments and prev_bits.
+// for_above[k] and for_below[k] are the threshold between levels k-1 and k 
+// (k = 1 .. VLEVEL_CNT-1) for deciding level k and level k-1 respectively.
+// The static adjustment pulls the thresholds in toward 0 in proportion 
+// (the top and bottom ones by the full amount); the dynamic one lowers a 
+// threshold when coming from below it and raises it when coming from above, 
+// except at the top and bottom.  For PAM4 this is the original
+// Vt_HIGH/Vt_MID/Vt_LOW scheme.
+//------------------------------------------------------------------
+template<uint32_t VLEVEL_CNT>
+struct Vts
 {
-    if ( argc != 2 ) die( "usage: analyze <raw_file>" );
-    std::string raw_file = std::string( argv[1] );
+    real   for_above[VLEVEL_CNT];       // [0] unused
+    real   for_below[VLEVEL_CNT];       // [0] unused
+};
+
+template<uint32_t VLEVEL_CNT>
+inline Vts<VLEVEL_CNT> pam_vts( double static_hi_lo_adjust, int prev_bits, double dynamic_hi_lo_adjust )
+{
+    constexpr uint32_t TOP = VLEVEL_CNT-1;
+    Vts<VLEVEL_CNT> vts;
+    vts.for_above[0] = real(0.0);
+    vts.for_below[0] = real(0.0);
+    for( uint32_t k = 1; k <= TOP; k++ )
+    {
+        const real vt      = vt_nominal<VLEVEL_CNT>( k ) - static_hi_lo_adjust * vt_static_frac<VLEVEL_CNT>( k );
+        const real dynamic = dynamic_hi_lo_adjust;
+        vts.for_above[k] = vt - ((prev_bits <  int(k) && k != 1)   ? dynamic : real(0.0));
+        vts.for_below[k] = vt + ((prev_bits >= int(k) && k != TOP) ? dynamic : real(0.0));
+    }
+    return vts;
+}
+
+template<uint32_t VLEVEL_CNT>
+int pam( real mV, real& vt, real& margin, double static_hi_lo_adjust=0.0, int prev_bits=0, double dynamic_hi_lo_adjust=0.0 )
+{
+    constexpr uint32_t TOP = VLEVEL_CNT-1;
+    const Vts<VLEVEL_CNT> vts = pam_vts<VLEVEL_CNT>( static_hi_lo_adjust, prev_bits, dynamic_hi_lo_adjust );
+    if ( mV > vts.for_above[TOP] ) {
+        vt     = vts.for_above[TOP];
+        margin = mV - vt;
+        return TOP;
+    }
+    for( uint32_t k = TOP-1; k >= 1; k-- )
+    {
+        if ( mV < vts.for_below[k+1] && mV > vts.for_above[k] ) {
+            vt     = vts.for_above[k];
+            margin = mV - vt;
+            if ( (vts.for_below[k+1]-mV) < margin ) {
+                vt     = vts.for_below[k+1];
+                margin = vt - mV;
+            }
+            return k;
+        }
+    }
+    vt     = vts.for_below[1];
+    margin = vt - mV;
+    return 0;
+}
+
+//------------------------------------------------------------------
+// Batch slicer.
+//
+// pam<4>()'s prev_bits comes from the previous chosen sample's decision, which 
+// serializes the sweep.  Instead, slice_batch() slices every sample for all 
+// 4 possible prev_bits at once, branch-free, and packs 4 bits per 
+// prev_bits into a code: bits in [1:0] and above-noise (including the 
+// previous RX sample rule) in [2].  The decision-feedback chain is then 
+// resolved by a cheap serial pass over the codes.
+//
+// The codes are sized for PAM4, so other level counts use sweep_offset().
+//
+// On x86-64 Linux with gcc, slice_batch() is cloned for AVX-512 and AVX2
+// and the best clone is picked at load time; elsewhere it is plain C++ 
+// that the compiler vectorizes as it can.
+//------------------------------------------------------------------
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define SLICE_TARGET_CLONES __attribute__((target_clones("avx512f","avx2","default")))
+#else
+#define SLICE_TARGET_CLONES
+#endif
+
+// SoA copy of the chosen RX samples for one rx_offset
+struct SliceBatch
+{
+    std::vector<real>   mv;             // chosen sample voltages
+    std::vector<real>   prev_mv;        // RX sample before each one (same as mv when there is none)
+};
+
+// The thresholds of all 4 prev_bits values; only the dynamic ones differ.
+struct SliceVts
+{
+    real   high_for_above[2];           // prev_bits <= 2, == 3
+    real   high_for_below;
+    real   mid_for_above[2];            // prev_bits <= 1, >= 2
+    real   mid_for_below[2];            // prev_bits <= 1, >= 2
+    real   low_for_above;
+    real   low_for_below[2];            // prev_bits == 0, >= 1
+};
+
+inline SliceVts slice_vts( double static_hi_lo_adjust, double dynamic_hi_lo_adjust )
+{
+    Vts<4> vts[4];
+    for( uint32_t p = 0; p < 4; p++ ) vts[p] = pam_vts<4>( static_hi_lo_adjust, p, dynamic_hi_lo_adjust );
+    SliceVts svts;
+    svts.high_for_above[0] = vts[0].for_above[3];
+    svts.high_for_above[1] = vts[3].for_above[3];
+    svts.high_for_below    = vts[0].for_below[3];
+    svts.mid_for_above[0]  = vts[0].for_above[2];
+    svts.mid_for_above[1]  = vts[2].for_above[2];
+    svts.mid_for_below[0]  = vts[0].for_below[2];
+    svts.mid_for_below[1]  = vts[2].for_below[2];
+    svts.low_for_above     = vts[0].for_above[1];
+    svts.low_for_below[0]  = vts[0].for_below[1];
+    svts.low_for_below[1]  = vts[1].for_below[1];
+    return svts;
+}
+
+// Same decision and above-noise result as pam<4>() for prev_bits P, without branches.
+// P is a template parameter so that compares shared between prev_bits values
+// are computed once per sample.  Integers are as wide as real to match the 
+// lanes of the compares (so float gets twice the lanes of double).
+using slice_lane_t = std::conditional_t<sizeof(real) == 4, uint32_t, uint64_t>;
+
+template<uint32_t P>
+inline slice_lane_t slice_one( real mV, const SliceVts& svts, slice_lane_t& above )
+{
+    const real   high_for_above = svts.high_for_above[P == 3];
+    const real   high_for_below = svts.high_for_below;
+    const real   mid_for_above  = svts.mid_for_above[P >= 2];
+    const real   mid_for_below  = svts.mid_for_below[P >= 2];
+    const real   low_for_above  = svts.low_for_above;
+    const real   low_for_below  = svts.low_for_below[P >= 1];
+    const real   noise          = NOISE_mV_MAX;
+    slice_lane_t is_11 = mV > high_for_above;
+    slice_lane_t is_10 = (mV < high_for_below) & (mV > mid_for_above) & (is_11 ^ 1);
+    slice_lane_t is_01 = (mV > low_for_above)  & (mV < mid_for_below) & ((is_11 | is_10) ^ 1);
+    slice_lane_t is_00 = (is_11 | is_10 | is_01) ^ 1;
+    above = (is_11 & slice_lane_t(mV - high_for_above > noise)) |
+            (is_10 & slice_lane_t(std::min( mV - mid_for_above, high_for_below - mV ) > noise)) |
+            (is_01 & slice_lane_t(std::min( mV - low_for_above, mid_for_below  - mV ) > noise)) |
+            (is_00 & slice_lane_t(low_for_below - mV > noise));
+    return 3*is_11 + 2*is_10 + is_01;
+}
+
+// 4-bit code for one sample and prev_bits P
+template<uint32_t P>
+inline slice_lane_t slice_code( real mV, real prev_mV, const SliceVts& svts )
+{
+    slice_lane_t above;
+    slice_lane_t prev_above;
+    slice_lane_t bits      = slice_one<P>( mV,      svts, above );
+    slice_lane_t prev_bits = slice_one<P>( prev_mV, svts, prev_above );
+    above |= slice_lane_t(prev_bits == bits) & prev_above;
+    return (bits | (above << 2)) << (4*P);
+}
+
+SLICE_TARGET_CLONES
+void slice_batch( const real * mv, const real * prev_mv, size_t cnt, const SliceVts& svts, uint16_t * codes )
+{
+    for( size_t k = 0; k < cnt; k++ )
+    {
+        codes[k] = slice_code<0>( mv[k], prev_mv[k], svts ) | slice_code<1>( mv[k], prev_mv[k], svts ) |
+                   slice_code<2>( mv[k], prev_mv[k], svts ) | slice_code<3>( mv[k], prev_mv[k], svts );
+    }
+}
+
+void make_slice_batch( const std::vector<real_store>& rx_mv, uint32_t rx_stride, uint32_t rx_offset, SliceBatch& batch )
+{
+    batch.mv.clear();
+    batch.prev_mv.clear();
+    for( size_t i = rx_offset; i < rx_mv.size(); i += rx_stride )
+    {
+        batch.mv.push_back( rx_mv[i] );
+        batch.prev_mv.push_back( (rx_stride > 1 && i != 0) ? rx_mv[i-1] : rx_mv[i] );
+    }
+}
+
+//------------------------------------------------------------------
+// Same as sweep_offset() below, using the batch slicer.
+//------------------------------------------------------------------
+void sweep_offset_batch( const SliceBatch& batch, double static_hi_lo_adjust, double dynamic_hi_lo_adjust, 
+                         int& prev_chosen_bits, SweepResult& result, std::vector<uint16_t>& codes )
+{
+    const SliceVts svts = slice_vts( static_hi_lo_adjust, dynamic_hi_lo_adjust );
+    size_t cnt = batch.mv.size();
+    codes.resize( cnt );
+    slice_batch( batch.mv.data(), batch.prev_mv.data(), cnt, svts, codes.data() );
+
+    uint32_t above_noise_cnt = 0;
+    uint32_t bits = prev_chosen_bits;
+    for( size_t k = 0; k < cnt; k++ )
+    {
+        uint32_t code = (codes[k] >> (4*bits)) & 0xf;
+        if ( k >= 2 ) above_noise_cnt += code >> 2;   // don't count start-up
+        bits = code & 3;
+    }
+    prev_chosen_bits       = bits;
+    result.cnt             = (cnt >= 2) ? (cnt - 2) : 0;
+    result.above_noise_cnt = above_noise_cnt;
+    result.pct             = double(above_noise_cnt) / double(result.cnt) * 100.0;
+}
+
+//------------------------------------------------------------------
+// Slice the RX samples at one rx_offset with the given Vt adjustments.
+// prev_chosen_bits carries over from the previous rx_offset, so the
+// rx_offsets of one (static, dynamic) pair must be run in order.
+//------------------------------------------------------------------
+template<uint32_t VLEVEL_CNT>
+void sweep_offset( const std::vector<real_store>& rx_mv, uint32_t rx_stride, uint32_t rx_offset, 
+                   double static_hi_lo_adjust, double dynamic_hi_lo_adjust, int& prev_chosen_bits, SweepResult& result )
+{
+    uint32_t cnt = 0;
+    uint32_t above_noise_cnt = 0;
+    uint32_t val_cnt[VLEVEL_CNT];
+    uint32_t val_above_noise_cnt[VLEVEL_CNT];
+    for( uint32_t i = 0; i < VLEVEL_CNT; i++ ) 
+    {
+        val_cnt[i] = 0;
+        val_above_noise_cnt[i] = 0;
+    }
+    for( size_t i = rx_offset; i < rx_mv.size(); i += rx_stride )
+    {
+        bool ignore = i == rx_offset || i == (rx_offset+rx_stride);
+        if ( !ignore ) cnt++;            // don't count start-up
+        const real mv = rx_mv[i];
+        real vt;
+        real margin;
+        int bits = pam<VLEVEL_CNT>( mv, vt, margin, static_hi_lo_adjust, prev_chosen_bits, dynamic_hi_lo_adjust );
+        if ( !ignore ) val_cnt[bits]++;  // don't count start-up
+        bool above_noise = margin > NOISE_mV_MAX;
+        bool prev_above_noise = false;
+        if ( rx_stride > 1 && i != 0 ) {
+            real prev_vt;
+            real prev_margin;
+            int prev_bits = pam<VLEVEL_CNT>( rx_mv[i-1], prev_vt, prev_margin, static_hi_lo_adjust, prev_chosen_bits, dynamic_hi_lo_adjust );
+            prev_above_noise = prev_bits == bits && prev_margin > NOISE_mV_MAX;
+        }
+        if ( !ignore && (above_noise || prev_above_noise) ) {
+            above_noise_cnt++;
+            val_above_noise_cnt[bits]++;
+        }
+        if ( debug ) printf( "RX: %5d %4d %1d %5d %4d %c\n", int(i), int(mv), bits, 
+                             int(vt), int(margin), ignore ? 'x' : above_noise ? '+' : prev_above_noise ? '^' : '-' );
+        prev_chosen_bits = bits;
+    }
+    for( uint32_t i = 0; i < VLEVEL_CNT; i++ ) 
+    {
+        if ( val_cnt[i] > 0 ) {
+            double val_pct = double(val_above_noise_cnt[i]) / double(val_cnt[i]) * 100.0;
+            if ( debug ) printf( "    %1d: above noise: %d of %d samples (%0.2f%%)\n", i, val_above_noise_cnt[i], val_cnt[i], val_pct );
+        } 
+    }
+    result.cnt             = cnt;
+    result.above_noise_cnt = above_noise_cnt;
+    result.pct             = double(above_noise_cnt) / double(cnt) * 100.0;
+}
+
+//------------------------------------------------------------------
+// Run the whole static_hi_lo_adjust x dynamic_hi_lo_adjust x rx_offset grid.
+// Each (static, dynamic) pair is one unit of work; threads pull pairs
+// from a shared counter and write into their own slots of results[],
+// so no locking is needed and results[] is the same for any thread_cnt.
+// With -cache, pairs already in the ScoreCache are not rerun.
+//------------------------------------------------------------------
+template<uint32_t VLEVEL_CNT>
+void sweep( const std::vector<real_store>& rx_mv, uint32_t rx_stride, std::vector<SweepResult>& results, uint64_t samples_key )
+{
+    const uint32_t pair_cnt = hi_lo_adjust_cnt * hi_lo_adjust_cnt;
+    results.resize( size_t(pair_cnt) * rx_stride );
+    auto static_adjust  = [&]( uint32_t p ) { return double(p / hi_lo_adjust_cnt) * hi_lo_adjust_step; };
+    auto dynamic_adjust = [&]( uint32_t p ) { return double(p % hi_lo_adjust_cnt) * hi_lo_adjust_step; };
+
+    std::unique_ptr<ScoreCache> cache;
+    std::vector<uint32_t> todo;
+    if ( cache_dir != "" ) cache.reset( new ScoreCache( samples_key, rx_stride ) );
+    for( uint32_t p = 0; p < pair_cnt; p++ )
+    {
+        if ( !cache || !cache->find( static_adjust( p ), dynamic_adjust( p ), &results[size_t(p)*rx_stride] ) ) todo.push_back( p );
+    }
+    if ( cache ) std::cout << "CACHE: " << (pair_cnt - todo.size()) << " of " << pair_cnt << " sweep pairs cached\n";
+    if ( todo.empty() ) return;
+
+    const bool batch_slicer = use_batch_slicer && VLEVEL_CNT == 4;
+    std::vector<SliceBatch> batches( batch_slicer ? rx_stride : 0 );
+    for( uint32_t rx_offset = 0; rx_offset < batches.size(); rx_offset++ )
+    {
+        make_slice_batch( rx_mv, rx_stride, rx_offset, batches[rx_offset] );
+    }
+
+    std::atomic<uint32_t> next_pair( 0 );
+    auto worker = [&]( void ) 
+    {
+        std::vector<uint16_t> codes;
+        for( ;; )
+        {
+            uint32_t t = next_pair++;
+            if ( t >= todo.size() ) break;
+            uint32_t p = todo[t];
+            double static_hi_lo_adjust  = static_adjust( p );
+            double dynamic_hi_lo_adjust = dynamic_adjust( p );
+            int    prev_chosen_bits     = 1;
+            for( uint32_t rx_offset = 0; rx_offset < rx_stride; rx_offset++ )
+            {
+                SweepResult& result = results[size_t(p)*rx_stride + rx_offset];
+                if ( batch_slicer ) {
+                    sweep_offset_batch( batches[rx_offset], static_hi_lo_adjust, dynamic_hi_lo_adjust, prev_chosen_bits, result, codes );
+                } else {
+                    sweep_offset<VLEVEL_CNT>( rx_mv, rx_stride, rx_offset, static_hi_lo_adjust, dynamic_hi_lo_adjust, prev_chosen_bits, result );
+                }
+            }
+        }
+    };
+
+    uint32_t cnt = debug ? 1 : (thread_cnt != 0) ? thread_cnt : std::thread::hardware_concurrency();
+    if ( cnt == 0 ) cnt = 1;
+    if ( cnt > todo.size() ) cnt = todo.size();
+    std::vector<std::thread> threads;
+    for( uint32_t t = 1; t < cnt; t++ )
+    {
+        threads.push_back( std::thread( worker ) );
+    }
+    worker();
+    for( auto& thread : threads ) 
+    {
+        thread.join();
+    }
+
+    if ( cache ) {
+        for( uint32_t p : todo ) cache->add( static_adjust( p ), dynamic_adjust( p ), &results[size_t(p)*rx_stride] );
+    }
+}
+
+//------------------------------------------------------------------
+// Number of pairs in a HistGroup with mv <= a and prev_mv <= b.
+//------------------------------------------------------------------
+inline uint32_t hist_cum( const HistGroup& g, double a, double b )
+{
+    auto bin = [&]( double x ) -> uint32_t 
+    { 
+        double f = std::floor( (x - g.lo_mv) / g.bin_mv ) + 1.0;
+        return (f <= 0.0) ? 0 : (f >= double(g.bin_cnt)) ? g.bin_cnt : uint32_t(f);
+    };
+    return g.cum[size_t(bin( a ))*(g.bin_cnt+1) + bin( b )];
+}
+
+// number of pairs with mv in (mv_lo, mv_hi] and prev_mv in (prev_lo, prev_hi]
+inline uint32_t hist_rect( const HistGroup& g, double mv_lo, double mv_hi, double prev_lo, double prev_hi )
+{
+    return hist_cum( g, mv_hi, prev_hi ) - hist_cum( g, mv_lo, prev_hi ) - hist_cum( g, mv_hi, prev_lo ) + hist_cum( g, mv_lo, prev_lo );
+}
+
+//------------------------------------------------------------------
+// Above-noise count of one pam() region (region_lo, region_hi] whose above-noise core 
+// is (core_lo, core_hi].  A sample counts if it is in the core, or if it is in the 
+// region but not the core and the previous RX sample is in the core (same bits, above noise).
+//------------------------------------------------------------------
+uint32_t hist_region( const HistGroup& g, double region_lo, double region_hi, double core_lo, double core_hi )
+{
+    core_lo = std::max( core_lo, region_lo );
+    core_hi = std::min( core_hi, region_hi );
+    if ( core_hi <= core_lo ) return 0;
+    constexpr double INF = 1e30;
+    return hist_rect( g, core_lo,   core_hi,   -INF,    INF     ) + 
+           hist_rect( g, region_lo, core_lo,   core_lo, core_hi ) +
+           hist_rect( g, core_hi,   region_hi, core_lo, core_hi );
+}
+
+//------------------------------------------------------------------
+// Above-noise count of one HistGroup for one set of Vt adjustments.
+// This follows pam<VLEVEL_CNT>() region by region using the same thresholds.
+//------------------------------------------------------------------
+template<uint32_t VLEVEL_CNT>
+uint32_t hist_score( const HistGroup& g, int prev_bits, double static_hi_lo_adjust, double dynamic_hi_lo_adjust )
+{
+    constexpr double   INF = 1e30;
+    constexpr uint32_t TOP = VLEVEL_CNT-1;
+    const Vts<VLEVEL_CNT> vts = pam_vts<VLEVEL_CNT>( static_hi_lo_adjust, prev_bits, dynamic_hi_lo_adjust );
+    double above[VLEVEL_CNT];
+    double below[VLEVEL_CNT];
+    for( uint32_t k = 1; k <= TOP; k++ )
+    {
+        above[k] = double(vts.for_above[k]);
+        below[k] = double(vts.for_below[k]);
+    }
+    uint32_t score = hist_region( g, above[TOP], INF, above[TOP]+NOISE_mV_MAX, INF );
+    for( uint32_t k = TOP-1; k >= 1; k-- )
+    {
+        score += hist_region( g, above[k], above[k+1], above[k]+NOISE_mV_MAX, below[k+1]-NOISE_mV_MAX );
+    }
+    return score + hist_region( g, -INF, above[1], -INF, below[1]-NOISE_mV_MAX );
+}
+
+//------------------------------------------------------------------
+// Histogram optimizer.
+// One pass over the RX samples collects (sample, previous RX sample) voltage pairs 
+// per (rx_offset, prev chosen bits), where prev chosen bits come from the unadjusted slicer.  
+// Each group is binned at the sweep step into a 2D cumulative histogram, and every grid 
+// point is then scored with a few table lookups instead of a pass over the samples,
+// so the step can be made much finer.  Because of the binning and the fixed prev bits,
+// the scores are estimates; the HIST_VERIFY_CNT best are re-scored exactly with 
+// sweep_offset() and only those results are filled in.
+//------------------------------------------------------------------
+template<uint32_t VLEVEL_CNT>
+void hist_sweep( const std::vector<real_store>& rx_mv, uint32_t rx_stride, std::vector<SweepResult>& results )
+{
+    std::vector<HistGroup> groups( rx_stride*VLEVEL_CNT );
+    std::vector<uint32_t>  cnts( rx_stride, 0 );
+    for( uint32_t rx_offset = 0; rx_offset < rx_stride; rx_offset++ )
+    {
+        int prev_chosen_bits = 1;
+        for( size_t i = rx_offset; i < rx_mv.size(); i += rx_stride )
+        {
+            real   vt;
+            real   margin;
+            double mv   = double(rx_mv[i]);
+            int    bits = pam<VLEVEL_CNT>( rx_mv[i], vt, margin );
+            bool ignore = i == rx_offset || i == (rx_offset+rx_stride);
+            if ( !ignore ) {
+                cnts[rx_offset]++;
+                HistGroup& g = groups[rx_offset*VLEVEL_CNT + prev_chosen_bits];
+                g.mv.push_back( mv );
+                g.prev_mv.push_back( (rx_stride > 1) ? double(rx_mv[i-1]) : mv );  // prev_mv == mv never rescues
+            }
+            prev_chosen_bits = bits;
+        }
+    }
 
     //------------------------------------------------------------------
-    // First skip through second 'Values:' header.
+    // Bin each group and estimate every grid point.
+    // Only one group's table is alive at a time.
     //------------------------------------------------------------------
-    std::ifstream fraw( raw_file );
-    if ( !fraw.is_open() ) die( "could not open raw file " + raw_file );
-    std::string s;
-    uint32_t values_cnt = 0;
-    while( values_cnt != 2 && std::getline( fraw, s ) )
+    const uint32_t pair_cnt = hi_lo_adjust_cnt * hi_lo_adjust_cnt;
+    const double   edge_mv  = vt_nominal<VLEVEL_CNT>( VLEVEL_CNT-1 ) + NOISE_mV_MAX + hi_lo_adjust_step;  // no threshold or core edge lies beyond this
+    const double   bin_mv   = std::max( hi_lo_adjust_step, 2.0*edge_mv / double(HIST_BIN_CNT_MAX) );
+    std::vector<double> estimates( size_t(pair_cnt) * rx_stride, 0.0 );
+    for( uint32_t gi = 0; gi < groups.size(); gi++ )
     {
-        if ( s.substr( 0, 7 ) == "Values:" ) {
-            values_cnt++;
+        HistGroup& g  = groups[gi];
+        uint32_t rx_offset = gi / VLEVEL_CNT;
+        int      prev_bits = gi % VLEVEL_CNT;
+        g.lo_mv   = -edge_mv;
+        g.bin_mv  = bin_mv;
+        g.bin_cnt = uint32_t( std::ceil( 2.0*edge_mv / bin_mv ) );
+        const uint32_t w = g.bin_cnt + 1;
+        g.cum.assign( size_t(w)*w, 0 );
+        for( size_t k = 0; k < g.mv.size(); k++ )
+        {
+            // bin i holds [lo_mv + (i-1)*bin_mv, lo_mv + i*bin_mv), clamped at both ends
+            auto bin = [&]( double x ) -> uint32_t 
+            {
+                double f = std::floor( (x - g.lo_mv) / g.bin_mv ) + 1.0;
+                return (f < 1.0) ? 1 : (f >= double(g.bin_cnt)) ? g.bin_cnt : uint32_t(f);
+            };
+            g.cum[size_t(bin( g.mv[k] ))*w + bin( g.prev_mv[k] )]++;
+        }
+        for( uint32_t i = 1; i < w; i++ )
+        {
+            for( uint32_t j = 1; j < w; j++ )
+            {
+                g.cum[size_t(i)*w + j] += g.cum[size_t(i-1)*w + j] + g.cum[size_t(i)*w + j-1] - g.cum[size_t(i-1)*w + j-1];
+            }
+        }
+
+        for( uint32_t p = 0; p < pair_cnt; p++ )
+        {
+            double static_hi_lo_adjust  = double(p / hi_lo_adjust_cnt) * hi_lo_adjust_step;
+            double dynamic_hi_lo_adjust = double(p % hi_lo_adjust_cnt) * hi_lo_adjust_step;
+            estimates[size_t(p)*rx_stride + rx_offset] += double(hist_score<VLEVEL_CNT>( g, prev_bits, static_hi_lo_adjust, dynamic_hi_lo_adjust ));
         }
+        g.cum.clear();
+        g.cum.shrink_to_fit();
+    }
+    for( size_t r = 0; r < estimates.size(); r++ )
+    {
+        uint32_t cnt = cnts[r % rx_stride];                 // 0 when the capture is too short for this rx_offset
+        estimates[r] = (cnt == 0) ? 0.0 : estimates[r] / double(cnt) * 100.0;
     }
 
     //------------------------------------------------------------------
-    // Read in all the values of iq_tx and iq_rx.
+    // Re-score the best estimates exactly.  A grid point's prev_chosen_bits 
+    // depends on the rx_offsets before it, so those are rerun too.
     //------------------------------------------------------------------
-    struct Entry
+    std::vector<size_t> order( estimates.size() );
+    for( size_t i = 0; i < order.size(); i++ ) order[i] = i;
+    size_t verify_cnt = std::min( size_t(HIST_VERIFY_CNT), order.size() );
+    std::partial_sort( order.begin(), order.begin() + verify_cnt, order.end(), 
+                       [&]( size_t a, size_t b ) { return estimates[a] > estimates[b] || (estimates[a] == estimates[b] && a < b); } );
+
+    results.assign( estimates.size(), SweepResult{ 0, 0, -1.0 } );
+    for( size_t v = 0; v < verify_cnt; v++ )
     {
-        int64_t index;
-        double  time_ps;
-        double  iq_tx_mv;
-        double  iq_rx_mv;
+        size_t   r         = order[v];
+        uint32_t p         = r / rx_stride;
+        uint32_t rx_offset = r % rx_stride;
+        double static_hi_lo_adjust  = double(p / hi_lo_adjust_cnt) * hi_lo_adjust_step;
+        double dynamic_hi_lo_adjust = double(p % hi_lo_adjust_cnt) * hi_lo_adjust_step;
+        int    prev_chosen_bits     = 1;
+        SweepResult result;
+        for( uint32_t o = 0; o <= rx_offset; o++ )
+        {
+            sweep_offset<VLEVEL_CNT>( rx_mv, rx_stride, o, static_hi_lo_adjust, dynamic_hi_lo_adjust, prev_chosen_bits, result );
+        }
+        if ( debug ) printf( "HIST: static_hi_lo_adjust=%0.2f dynamic_hi_lo_adjust=%0.2f rx_offset=%d estimate=%0.2f%% exact=%0.2f%%\n",
+                             static_hi_lo_adjust, dynamic_hi_lo_adjust, rx_offset, estimates[r], result.pct );
+        results[r] = result;
+    }
+}
+
+//------------------------------------------------------------------
+// -opt adapt: a streaming receiver model instead of a search.
+//
+// One pass over the RX samples, one UI at a time, deciding each symbol 
+// with the Vt adjustments and sampling phase adapted so far.  As in a 
+// SerDes eye monitor, shadow slicers score the same UI with each setting 
+// moved by ADAPT_DITHER_mV up and down (and the phase one RX sample 
+// early and late); the score is sweep_offset()'s above-noise test:
+//
+// - Vt adjustments: sign-sign updates.  Every ADAPT_WINDOW_UI UIs, the 
+//   static and dynamic adjustments each move one -step toward the shadow 
+//   slicer that scored better, kept in [0, -adjust_max].
+// - CDR: a bang-bang loop.  Each UI votes early or late; every 
+//   ADAPT_CDR_VOTES net votes move the sampling phase one RX sample.
+//   The net votes leak away by 1/ADAPT_CDR_DECAY every ADAPT_WINDOW_UI 
+//   UIs, so only a steady early or late trend moves the phase, not the
+//   random walk of the votes at a centered phase.
+//
+// Cost is O(samples) regardless of -step and -adjust_max.
+//------------------------------------------------------------------
+struct AdaptResult
+{
+    double   static_hi_lo_adjust;       // final values
+    double   dynamic_hi_lo_adjust;
+    uint32_t rx_offset;
+    uint64_t lock_ui;                   // first UI from which the phase stayed put and the adjustments stayed within ADAPT_LOCK_mV of their final values
+    uint64_t phase_move_cnt;
+    SweepResult result;                 // all UIs but the start-up ones
+    SweepResult locked_result;          // UIs from lock_ui on
+};
+
+inline int sign( double x ) { return (x > 0.0) - (x < 0.0); }
+
+// sweep_offset()'s above-noise test for RX sample i
+template<uint32_t VLEVEL_CNT>
+inline bool adapt_above_noise( const std::vector<real_store>& rx_mv, size_t i, uint32_t rx_stride, 
+                               double static_hi_lo_adjust, int prev_chosen_bits, double dynamic_hi_lo_adjust, int& bits )
+{
+    real vt;
+    real margin;
+    bits = pam<VLEVEL_CNT>( rx_mv[i], vt, margin, static_hi_lo_adjust, prev_chosen_bits, dynamic_hi_lo_adjust );
+    if ( margin > NOISE_mV_MAX ) return true;
+    if ( rx_stride == 1 || i == 0 ) return false;
+    int prev_bits = pam<VLEVEL_CNT>( rx_mv[i-1], vt, margin, static_hi_lo_adjust, prev_chosen_bits, dynamic_hi_lo_adjust );
+    return prev_bits == bits && margin > NOISE_mV_MAX;
+}
+
+template<uint32_t VLEVEL_CNT>
+AdaptResult adapt_rx( const std::vector<real_store>& rx_mv, uint32_t rx_stride )
+{
+    auto clamp = []( double x ) { return std::min( std::max( x, 0.0 ), hi_lo_adjust_range ); };
+    auto score = [&]( size_t i, double static_hi_lo_adjust, int prev_chosen_bits, double dynamic_hi_lo_adjust ) 
+    {
+        int bits;
+        return int(adapt_above_noise<VLEVEL_CNT>( rx_mv, i, rx_stride, static_hi_lo_adjust, prev_chosen_bits, dynamic_hi_lo_adjust, bits ));
     };
-    std::vector<Entry> entries;
 
-    while( std::getline( fraw, s ) )
+    double   static_hi_lo_adjust  = 0.0;
+    double   dynamic_hi_lo_adjust = 0.0;
+    int      prev_chosen_bits     = 1;
+    int32_t  static_votes  = 0;
+    int32_t  dynamic_votes = 0;
+    int32_t  phase_votes   = 0;
+    uint64_t phase_move_cnt = 0;
+    uint64_t phase_move_ui  = 0;                  // UI after the last phase move
+
+    std::vector<float>   static_history;          // per UI, for the lock time
+    std::vector<float>   dynamic_history;
+    std::vector<uint8_t> counted;                 // per UI: 0 ignored, 1 counted, 2 counted and above noise
+    static_history.reserve( rx_mv.size() / rx_stride + 1 );
+    dynamic_history.reserve( rx_mv.size() / rx_stride + 1 );
+    counted.reserve( rx_mv.size() / rx_stride + 1 );
+
+    size_t i = 0;
+    size_t last_i = 0;
+    for( uint64_t ui = 0; i < rx_mv.size(); ui++ )
     {
-        size_t e = entries.size();
-        entries.resize( e+1 );
-        Entry& entry = entries[e];
+        last_i = i;
+        int  bits;
+        bool above_noise = adapt_above_noise<VLEVEL_CNT>( rx_mv, i, rx_stride, static_hi_lo_adjust, prev_chosen_bits, dynamic_hi_lo_adjust, bits );
+        counted.push_back( (ui < 2) ? 0 : above_noise ? 2 : 1 );
+
+        // shadow slicers
+        static_votes  += score( i, static_hi_lo_adjust + ADAPT_DITHER_mV, prev_chosen_bits, dynamic_hi_lo_adjust ) - 
+                         score( i, static_hi_lo_adjust - ADAPT_DITHER_mV, prev_chosen_bits, dynamic_hi_lo_adjust );
+        dynamic_votes += score( i, static_hi_lo_adjust, prev_chosen_bits, dynamic_hi_lo_adjust + ADAPT_DITHER_mV ) - 
+                         score( i, static_hi_lo_adjust, prev_chosen_bits, dynamic_hi_lo_adjust - ADAPT_DITHER_mV );
+        if ( (ui+1) % ADAPT_WINDOW_UI == 0 ) {
+            static_hi_lo_adjust  = clamp( static_hi_lo_adjust  + sign( static_votes )  * hi_lo_adjust_step );
+            dynamic_hi_lo_adjust = clamp( dynamic_hi_lo_adjust + sign( dynamic_votes ) * hi_lo_adjust_step );
+            static_votes  = 0;
+            dynamic_votes = 0;
+        }
+        static_history.push_back( static_hi_lo_adjust );
+        dynamic_history.push_back( dynamic_hi_lo_adjust );
+
+        // CDR
+        int step = 0;
+        if ( rx_stride > 2 && i > 1 && (i+1) < rx_mv.size() ) {
+            phase_votes += score( i+1, static_hi_lo_adjust, prev_chosen_bits, dynamic_hi_lo_adjust ) -
+                           score( i-1, static_hi_lo_adjust, prev_chosen_bits, dynamic_hi_lo_adjust );
+            if ( phase_votes >= ADAPT_CDR_VOTES || phase_votes <= -ADAPT_CDR_VOTES ) {
+                step = sign( phase_votes );
+                phase_votes = 0;
+                phase_move_cnt++;
+                phase_move_ui = ui + 1;
+            } else if ( (ui+1) % ADAPT_WINDOW_UI == 0 ) {
+                phase_votes -= phase_votes / ADAPT_CDR_DECAY;
+            }
+        }
+
+        if ( debug ) printf( "ADAPT: ui=%d i=%d bits=%d %c static=%0.2f dynamic=%0.2f votes=%d/%d/%d\n", int(ui), int(i), bits, above_noise ? '+' : '-', 
+                             static_hi_lo_adjust, dynamic_hi_lo_adjust, static_votes, dynamic_votes, phase_votes );
+        prev_chosen_bits = bits;
+        i += rx_stride + step;
+    }
 
-        size_t pos = 0;
-        entry.index   = parse_int( s, pos );
-        entry.time_ps = parse_flt( s, pos ) * 1.0e12;
-        for( uint32_t i = 0; i < 4; i++ )
+    AdaptResult r;
+    r.static_hi_lo_adjust  = static_hi_lo_adjust;
+    r.dynamic_hi_lo_adjust = dynamic_hi_lo_adjust;
+    r.rx_offset            = last_i % rx_stride;
+    r.phase_move_cnt       = phase_move_cnt;
+    r.lock_ui              = counted.size();
+    while( r.lock_ui > phase_move_ui && std::fabs( static_history[r.lock_ui-1]  - static_hi_lo_adjust )  <= ADAPT_LOCK_mV &&
+                            std::fabs( dynamic_history[r.lock_ui-1] - dynamic_hi_lo_adjust ) <= ADAPT_LOCK_mV ) 
+    {
+        r.lock_ui--;
+    }
+    SweepResult * results[2] = { &r.result, &r.locked_result };
+    for( uint32_t k = 0; k < 2; k++ )
+    {
+        SweepResult& result = *results[k];
+        result.cnt = 0;
+        result.above_noise_cnt = 0;
+        for( uint64_t ui = (k == 0) ? 0 : r.lock_ui; ui < counted.size(); ui++ )
         {
-            if ( !std::getline( fraw, s ) ) die( "truncated entry at end of file" );
-            pos = 0;
-            if ( i == 2 ) entry.iq_tx_mv = parse_flt( s, pos ) *  500.0;   // in RX terms
-            if ( i == 3 ) entry.iq_rx_mv = parse_flt( s, pos ) * 1000.0;
+            result.cnt             += counted[ui] != 0;
+            result.above_noise_cnt += counted[ui] == 2;
         }
+        result.pct = (result.cnt == 0) ? 0.0 : double(result.above_noise_cnt) / double(result.cnt) * 100.0;
     }
-    fraw.close();
+    return r;
+}
 
-    //------------------------------------------------------------------
-    // Sample iq_tx and iq_rx values at their periods.
-    // Write the samples to new lists.
-    //------------------------------------------------------------------
-    struct Sample
+//------------------------------------------------------------------
+// Sample the iq_tx and iq_rx values of a source (RawFile or QamBinSource) at 
+// their periods as they go by.  Only the RX samples are kept, for each
+// of the RX streams (sample rates and phases) at once.
+// If eye is not null, iq_rx is also added to it at each eye time bin.
+// Returns the number of entries read.
+//
+// With -interp cubic, each RX sample is interpolated from the 4 entries 
+// around it, which is one entry behind the source.  Entries at the same 
+// time as the one before replace it, so that the 4 times are distinct.
+//------------------------------------------------------------------
+inline double lagrange4( const Entry * e, double time_ps )
+{
+    double v = 0.0;
+    for( uint32_t j = 0; j < 4; j++ )
     {
-        double time_ps;
-        double iq_mv;
-        double margin;
-        int    bits;
-    };
-    std::vector<Sample> tx_samples;
-    std::vector<Sample> rx_samples;
+        double w = 1.0;
+        for( uint32_t m = 0; m < 4; m++ )
+        {
+            if ( m != j ) w *= (time_ps - e[m].time_ps) / (e[j].time_ps - e[m].time_ps);
+        }
+        v += w * e[j].iq_rx_mv;
+    }
+    return v;
+}
+
+template<uint32_t VLEVEL_CNT, typename Source>
+uint64_t sample_rx( Source& source, std::vector<RxStream>& streams, EyeDiagram * eye )
+{
+    uint64_t entry_cnt = 0;
     Entry entry_prev{ -1, -TX_CLK_PERIOD_PS, RX_mV_MAX, 0.0 };
     Entry entry;
+    Entry    history[4];                // -interp cubic: the last 4 entries, oldest first
+    uint64_t history_cnt = 0;
     double iq_tx_time_ps = 0.0;
-    double iq_rx_time_ps = 0.0;
-    std::vector<double> iq_tx_values;
-    std::vector<double> iq_rx_values;
-    for( auto it = entries.begin(); it != entries.end(); it++ )
+    for( auto& stream : streams ) stream.time_ps = stream.phase_ps;
+
+    auto add_rx = [&]( RxStream& stream, real iq_rx )
     {
-        entry = *it;
+        if ( debug ) {
+            real     vt;
+            real     margin;
+            uint32_t bits = pam<VLEVEL_CNT>( iq_rx, vt, margin );
+            bool above_noise = margin > NOISE_mV_MAX;
+            printf( "RX: %5d %4d %1d %5d %4d %c\n", int(stream.time_ps), int(iq_rx), bits, int(vt), int(margin), above_noise ? '+' : '-' );
+        }
+
+        std::vector<real_store>& rx_mv = stream.mv;
+        if ( rx_window != 0 && rx_mv.size() == 2*rx_window ) {
+            rx_mv.erase( rx_mv.begin(), rx_mv.begin() + rx_window );
+            stream.first_i += rx_window;
+        }
+        rx_mv.push_back( iq_rx );
+    };
 
-        // iq_tx
-        if ( entry.time_ps >= iq_tx_time_ps ) {
+    uint64_t eye_i       = uint64_t(EYE_SKIP_UI_CNT) * EYE_T_BIN_CNT;
+    double   eye_time_ps = double(eye_i) * EYE_T_BIN_PS;
+    while( source.next( entry ) )
+    {
+        entry_cnt++;
+
+        // eye diagram (the entries can be farther apart than the eye time bins)
+        while( eye != nullptr && entry.time_ps >= eye_time_ps ) 
+        {
+            double a = (entry.time_ps == entry_prev.time_ps) ? 1.0 : (eye_time_ps - entry_prev.time_ps) / (entry.time_ps - entry_prev.time_ps);
+            eye->add( eye_i % EYE_T_BIN_CNT, lerp( entry.iq_rx_mv, entry_prev.iq_rx_mv, a ) );
+            eye_i++;
+            eye_time_ps = double(eye_i) * EYE_T_BIN_PS;
+        }
+
+        // iq_tx (only looked at when debugging)
+        if ( debug && entry.time_ps >= iq_tx_time_ps ) {
             double a     = (iq_tx_time_ps - entry_prev.time_ps) / (entry.time_ps - entry_prev.time_ps); 
-            double iq_tx = lerp( entry_prev.iq_tx_mv, entry.iq_tx_mv, a );
-            size_t vi    = iq_tx_values.size();
-            iq_tx_values.resize( vi+1 );
-            iq_tx_values[vi] = iq_tx;
+            real   iq_tx = lerp( entry_prev.iq_tx_mv, entry.iq_tx_mv, a );
             iq_tx_time_ps += TX_CLK_PERIOD_PS;
-            double   vt;
-            double   margin;
-            uint32_t bits = pam4( iq_tx, vt, margin );
-            bool above_noise = margin > NOISE_mV_MAX;
-            if ( debug ) printf( "TX: %5d %4d %1d %5d %4d %c\n", int(entry.time_ps), int(iq_tx), bits, int(vt), int(margin), above_noise ? '+' : '-' );
-
-            size_t si = tx_samples.size();
-            tx_samples.resize( si+1 );
-            Sample& sample = tx_samples[si];
-            sample.time_ps = iq_tx_time_ps;
-            sample.iq_mv   = iq_tx;
-            sample.margin  = margin;
-            sample.bits    = bits;
-        }
-
-        // iq_rx
-        if ( entry.time_ps >= iq_rx_time_ps ) {
-            double a     = (iq_rx_time_ps - entry_prev.time_ps) / (entry.time_ps - entry_prev.time_ps); 
-            double iq_rx = lerp( entry_prev.iq_rx_mv, entry.iq_rx_mv, a );
-            size_t vi    = iq_rx_values.size();
-            iq_rx_values.resize( vi+1 );
-            iq_rx_values[vi] = iq_rx;
-            iq_rx_time_ps += RX_CLK_PERIOD_PS;
-            double   vt;
-            double   margin;
-            uint32_t bits = pam4( iq_rx, vt, margin );
+            real     vt;
+            real     margin;
+            uint32_t bits = pam<VLEVEL_CNT>( iq_tx, vt, margin );
             bool above_noise = margin > NOISE_mV_MAX;
-            if ( debug ) printf( "RX: %5d %4d %1d %5d %4d %c\n", int(entry.time_ps), int(iq_rx), bits, int(vt), int(margin), above_noise ? '+' : '-' );
+            printf( "TX: %5d %4d %1d %5d %4d %c\n", int(entry.time_ps), int(iq_tx), bits, int(vt), int(margin), above_noise ? '+' : '-' );
+        }
 
-            size_t si = rx_samples.size();
-            rx_samples.resize( si+1 );
-            Sample& sample = rx_samples[si];
-            sample.time_ps = iq_rx_time_ps;
-            sample.iq_mv   = iq_rx;
-            sample.margin  = margin;
-            sample.bits    = bits;
+        // iq_rx (the ADC)
+        if ( !interp_cubic ) {
+            for( auto& stream : streams )
+            {
+                while( entry.time_ps >= stream.time_ps )            // rates above the entry rate take several
+                {
+                    double a     = (entry.time_ps == entry_prev.time_ps) ? 1.0 : (stream.time_ps - entry_prev.time_ps) / (entry.time_ps - entry_prev.time_ps); 
+                    real   iq_rx = lerp( entry.iq_rx_mv, entry_prev.iq_rx_mv, a );
+                    stream.time_ps += stream.period_ps;
+                    add_rx( stream, iq_rx );
+                }
+            }
+        } else {
+            if ( history_cnt != 0 && entry.time_ps == history[3].time_ps ) {
+                history[3] = entry;             // repeated time point (ngspice breakpoints): keep the later value
+            } else {
+                std::copy( history+1, history+4, history );
+                history[3] = entry;
+                history_cnt++;
+            }
+            if ( history_cnt >= 4 ) {
+                for( auto& stream : streams )
+                {
+                    while( stream.time_ps < history[2].time_ps ) 
+                    {
+                        real iq_rx = lagrange4( history, stream.time_ps );
+                        stream.time_ps += stream.period_ps;
+                        add_rx( stream, iq_rx );
+                    }
+                }
+            }
         }
 
         entry_prev = entry;
     }
 
+    // -interp cubic: the last interval has no entry after it
+    for( auto& stream : streams )
+    {
+        while( interp_cubic && history_cnt >= 2 && stream.time_ps <= history[3].time_ps ) 
+        {
+            double a     = (stream.time_ps - history[2].time_ps) / (history[3].time_ps - history[2].time_ps);
+            real   iq_rx = lerp( history[3].iq_rx_mv, history[2].iq_rx_mv, a );
+            stream.time_ps += stream.period_ps;
+            add_rx( stream, iq_rx );
+        }
+    }
+    return entry_cnt;
+}
+
+// one stream at RX_CLK_GHZ
+template<uint32_t VLEVEL_CNT, typename Source>
+uint64_t sample_rx( Source& source, std::vector<real_store>& rx_mv, EyeDiagram * eye )
+{
+    std::vector<RxStream> streams( 1, rx_stream( RX_CLK_GHZ, 0.0 ) );
+    streams[0].mv.swap( rx_mv );
+    uint64_t entry_cnt = sample_rx<VLEVEL_CNT>( source, streams, eye );
+    rx_mv.swap( streams[0].mv );
+    return entry_cnt;
+}
+
+//------------------------------------------------------------------
+// -stat: statistical eye and BER bathtubs.
+//
+// Counting errors can't see a BER below about 1 / the number of UIs, so 
+// instead the low tails of the margin distributions are extrapolated.
+// Each UI's symbol is taken to be the level decided at the best rx_offset 
+// with the best Vt adjustments.  For each RX sample phase in the UI around 
+// that rx_offset and each level, the margins of that level's samples to 
+// the thresholds above and below it (with the dynamic adjustment for the 
+// previous UI's level) go into STAT_BIN_mV histograms.  The lowest 
+// STAT_TAIL_FRAC of each histogram is fit with a Gaussian, as a straight 
+// line of q_inv( P(margin < x) ) against x, which gives P(margin < x) below 
+// the smallest margin seen.
+//
+// The BER at a phase with all thresholds moved up by vt_offset is then the 
+// level-weighted sum of P(margin to the threshold above < -vt_offset) and 
+// P(margin to the threshold below < vt_offset).  The best Vt adjustments 
+// maximize margin above noise rather than minimize BER, so the bathtubs 
+// go through the phase and threshold offset with the lowest BER.
+//------------------------------------------------------------------
+class MarginTail
+{
+public:
+    MarginTail( void ) : n( 0 ), cnt( STAT_BIN_CNT+1, 0 ), tail_hi_mv( 0.0 ), mu_mv( 0.0 ), sigma_mv( STAT_BIN_mV ) {}
+
+    uint64_t n;                         // samples added
+
+    inline void add( double margin_mv ) 
+    { 
+        double f = std::floor( (margin_mv + STAT_MARGIN_mV_MAX) / STAT_BIN_mV );
+        cnt[(f <= 0.0) ? 0 : (f >= double(STAT_BIN_CNT-1)) ? (STAT_BIN_CNT-1) : uint32_t(f)]++;
+        n++;
+    }
+
+    void   fit( void );                 // after the last add()
+    double p_below( double x_mv ) const;
+
+private:
+    std::vector<uint32_t> cnt;          // per bin, then by fit(), [e] is the count below bin edge e
+    double   tail_hi_mv;                // highest bin edge fit
+    double   mu_mv;
+    double   sigma_mv;
+
+    static inline double edge_mv( uint32_t e ) { return double(e) * STAT_BIN_mV - STAT_MARGIN_mV_MAX; }
+};
+
+void MarginTail::fit( void )
+{
+    uint32_t below = 0;
+    for( uint32_t e = 0; e <= STAT_BIN_CNT; e++ )
+    {
+        uint32_t c = cnt[e];
+        cnt[e] = below;
+        below += c;
+    }
+    if ( n == 0 ) return;
+
+    // least-squares line y = a + b*x through (edge, q_inv( P(margin < edge) )), b = -1/sigma
+    double   sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+    uint32_t pt_cnt = 0;
+    for( uint32_t e = 1; e <= STAT_BIN_CNT && cnt[e] < n; e++ )
+    {
+        if ( cnt[e] == 0 ) continue;
+        if ( pt_cnt >= STAT_TAIL_MIN_CNT && double(cnt[e]) > STAT_TAIL_FRAC * double(n) ) break;
+        double x = edge_mv( e );
+        double y = q_inv( double(cnt[e]) / double(n) );
+        sx  += x;
+        sy  += y;
+        sxx += x*x;
+        sxy += x*y;
+        tail_hi_mv = x;
+        pt_cnt++;
+    }
+    if ( pt_cnt == 0 ) {
+        // all in one bin
+        for( uint32_t e = 1; e <= STAT_BIN_CNT; e++ ) if ( cnt[e] == n ) { tail_hi_mv = edge_mv( e-1 ); break; }
+        mu_mv = tail_hi_mv + STAT_BIN_mV/2.0;
+        return;
+    }
+    double d = double(pt_cnt)*sxx - sx*sx;
+    double b = (pt_cnt >= 2 && d > 0.0) ? (double(pt_cnt)*sxy - sx*sy) / d : 0.0;
+    if ( b < 0.0 ) sigma_mv = -1.0 / b;         // else keep one bin
+    mu_mv = (sigma_mv*sy + sx) / double(pt_cnt);  // y = (mu - x) / sigma at the mean point
+}
+
+// P( margin < x_mv ): the fit within and below the tail, else the histogram
+double MarginTail::p_below( double x_mv ) const
+{
+    if ( n == 0 ) return 0.0;
+    if ( x_mv <= tail_hi_mv ) return q_func( (mu_mv - x_mv) / sigma_mv );
+    double f = std::floor( (x_mv + STAT_MARGIN_mV_MAX) / STAT_BIN_mV );
+    uint32_t e = (f >= double(STAT_BIN_CNT)) ? STAT_BIN_CNT : uint32_t(f);
+    return double(cnt[e]) / double(n);
+}
+
+template<uint32_t VLEVEL_CNT>
+void stat_rx( const RxStream& stream, uint32_t rx_stride, uint32_t rx_offset, double static_hi_lo_adjust, double dynamic_hi_lo_adjust )
+{
+    constexpr uint32_t TOP = VLEVEL_CNT-1;
+    const std::vector<real_store>& rx_mv = stream.mv;
+    const int32_t phase_first = -int32_t(rx_stride/2);   // RX samples relative to rx_offset
+
+    // each UI's level
+    std::vector<uint8_t> levels;
+    int bits = 0;
+    for( size_t i = rx_offset; i < rx_mv.size(); i += rx_stride )
+    {
+        real vt;
+        real margin;
+        bits = pam<VLEVEL_CNT>( rx_mv[i], vt, margin, static_hi_lo_adjust, bits, dynamic_hi_lo_adjust );
+        levels.push_back( bits );
+    }
+
+    // [phase][level] margins to the thresholds above and below the level
+    std::vector<MarginTail> above( size_t(rx_stride) * VLEVEL_CNT );
+    std::vector<MarginTail> below( size_t(rx_stride) * VLEVEL_CNT );
+    for( size_t u = 2; u < levels.size(); u++ )         // don't count start-up
+    {
+        const Vts<VLEVEL_CNT> vts = pam_vts<VLEVEL_CNT>( static_hi_lo_adjust, levels[u-1], dynamic_hi_lo_adjust );
+        const uint32_t l = levels[u];
+        for( uint32_t k = 0; k < rx_stride; k++ )
+        {
+            int64_t i = int64_t(u*rx_stride + rx_offset) + phase_first + k;
+            if ( i >= int64_t(rx_mv.size()) ) break;
+            const real mv = rx_mv[i];
+            if ( l != TOP ) above[size_t(k)*VLEVEL_CNT + l].add( double(vts.for_below[l+1] - mv) );
+            if ( l != 0 )   below[size_t(k)*VLEVEL_CNT + l].add( double(mv - vts.for_above[l]) );
+        }
+    }
+    for( auto& t : above ) t.fit();
+    for( auto& t : below ) t.fit();
+
+    auto ber_at = [&]( uint32_t k, double vt_offset )
+    {
+        double   err = 0.0;
+        uint64_t cnt = 0;
+        for( uint32_t l = 0; l < VLEVEL_CNT; l++ )
+        {
+            const MarginTail& a = above[size_t(k)*VLEVEL_CNT + l];
+            const MarginTail& b = below[size_t(k)*VLEVEL_CNT + l];
+            uint64_t n = (l != TOP) ? a.n : b.n;
+            err += double(n) * (a.p_below( -vt_offset ) + b.p_below( vt_offset ));
+            cnt += n;
+        }
+        return (cnt == 0) ? 1.0 : (err / double(cnt));
+    };
+
+    printf( "\nSTAT: rx_stride=%d rx_offset=%d static_hi_lo_adjust=%0.2f dynamic_hi_lo_adjust=%0.2f uis=%d tail_frac=%0.2f\n", 
+            rx_stride, rx_offset, static_hi_lo_adjust, dynamic_hi_lo_adjust, int((levels.size() > 2) ? (levels.size()-2) : 0), STAT_TAIL_FRAC );
+    // the lowest BER over phases and threshold offsets, then the bathtubs through it
+    const double vt_max = RX_mV_MAX / double(TOP);      // half the spacing between levels
+    std::vector<double> vt_mv;
+    for( double vt_offset = -std::floor( vt_max / STAT_VT_STEP_mV ) * STAT_VT_STEP_mV; vt_offset <= vt_max; vt_offset += STAT_VT_STEP_mV ) vt_mv.push_back( vt_offset );
+    uint32_t best_k   = 0;
+    size_t   best_vt  = 0;
+    double   best_ber = 2.0;
+    for( uint32_t k = 0; k < rx_stride; k++ )
+    {
+        for( size_t v = 0; v < vt_mv.size(); v++ )
+        {
+            double ber = ber_at( k, vt_mv[v] );
+            if ( ber < best_ber ) {
+                best_ber = ber;
+                best_k   = k;
+                best_vt  = v;
+            }
+        }
+    }
+    std::vector<double> t_ps( rx_stride );
+    std::vector<double> t_ber( rx_stride );
+    for( uint32_t k = 0; k < rx_stride; k++ )
+    {
+        t_ps[k]  = double(phase_first + int32_t(k)) * stream.period_ps;
+        t_ber[k] = ber_at( k, vt_mv[best_vt] );
+        printf( "BATHTUB: phase=%0.2f ps vt_offset=%0.2f mV ber=%0.3e\n", t_ps[k], vt_mv[best_vt], t_ber[k] );
+    }
+    std::vector<double> vt_ber( vt_mv.size() );
+    for( size_t v = 0; v < vt_mv.size(); v++ )
+    {
+        vt_ber[v] = ber_at( best_k, vt_mv[v] );
+        printf( "BATHTUB: phase=%0.2f ps vt_offset=%0.2f mV ber=%0.3e\n", t_ps[best_k], vt_mv[v], vt_ber[v] );
+    }
+    for( double target : BER_TARGETS )
+    {
+        printf( "STAT: ber=%0.0e eye_width=%0.2f ps eye_height=%0.2f mV\n", target, 
+                bathtub_opening( t_ps, t_ber, target ), bathtub_opening( vt_mv, vt_ber, target ) );
+    }
+}
+
+//------------------------------------------------------------------
+// Sweep the RX samples of a stream for VLEVEL_CNT voltage levels and print the best.
+// Returns the best above-noise percentage.
+//------------------------------------------------------------------
+template<uint32_t VLEVEL_CNT>
+double analyze_rx( const RxStream& stream )
+{
+    const std::vector<real_store>& rx_mv = stream.mv;
+    double result_pct = 0.0;
     //------------------------------------------------------------------
     // Print all RX samples.
     //------------------------------------------------------------------
     if ( debug ) {
-        for( size_t i = 0; i < rx_samples.size(); i++ )
+        for( size_t i = 0; i < rx_mv.size(); i++ )
         {
-            const Sample& sample = rx_samples[i];
-            bool above_noise = sample.margin > NOISE_mV_MAX;
-            printf( "RX: %5d %4d %1d %4d %c\n", int(sample.time_ps), int(sample.iq_mv), sample.bits, 
-                    int(sample.margin), above_noise ? '+' : '-' );
+            const real mv = rx_mv[i];
+            real vt;
+            real margin;
+            int  bits = pam<VLEVEL_CNT>( mv, vt, margin );
+            bool above_noise = margin > NOISE_mV_MAX;
+            printf( "RX: %5d %4d %1d %4d %c\n", int(stream.sample_time_ps( i )), int(mv), bits, 
+                    int(margin), above_noise ? '+' : '-' );
         }
         printf( "------------------------------------------------------------------------------\n" );
     }
@@ -277,7 +1828,7 @@ int main( int argc, const char * argv[] )
     //------------------------------------------------------------------
     for( uint32_t stride_i = 1; stride_i < 2; stride_i++ )
     {
-        const uint32_t rx_stride = (stride_i == 0) ? 1 : (RX_CLK_GHZ / TX_CLK_GHZ);
+        const uint32_t rx_stride = (stride_i == 0) ? 1 : stream.stride;
 
         double   best_pct = 0.0;
         double   best_static_hi_lo_adjust = 0.0;
@@ -285,73 +1836,53 @@ int main( int argc, const char * argv[] )
         uint32_t best_rx_offset = 0;
 
         //------------------------------------------------------------------
-        // Try various Vt_HIGH/Vt_LOW.
+        // Try various Vt_HIGH/Vt_LOW (the outer thresholds, with the inner ones pulled in proportionally).
         // Assume that we'll never want to make Vt_HIGH higher (or Vt_LOW lower).
+        // Also try various Vt_HIGH/Vt_LOW adjustments when coming from extreme bits values
+        // and various RX time offsets.  (-opt adapt instead tracks them in one pass.)
         //------------------------------------------------------------------
-        for( double static_hi_lo_adjust = 0.0; static_hi_lo_adjust <= Vt_HIGH/4; static_hi_lo_adjust += 1.0 )
+        std::vector<SweepResult> results;
+        if ( opt_adapt ) {
+            Perf::Scope scope( perf, "adapt" );
+            AdaptResult r = adapt_rx<VLEVEL_CNT>( rx_mv, rx_stride );
+            scope.count( "uis", r.result.cnt );
+            printf( "ADAPT: rx_stride=%d static_hi_lo_adjust=%0.2f dynamic_hi_lo_adjust=%0.2f rx_offset=%d phase_moves=%d\n", 
+                    rx_stride, r.static_hi_lo_adjust, r.dynamic_hi_lo_adjust, r.rx_offset, int(r.phase_move_cnt) );
+            printf( "ADAPT: locked at UI %d (%0.2f ns); above noise: %d of %d samples (%0.2f%%), %d of %d after lock (%0.2f%%)\n", 
+                    int(r.lock_ui), double(r.lock_ui) * TX_CLK_PERIOD_PS / 1000.0, r.result.above_noise_cnt, r.result.cnt, r.result.pct,
+                    r.locked_result.above_noise_cnt, r.locked_result.cnt, r.locked_result.pct );
+            best_pct                  = r.result.pct;
+            best_static_hi_lo_adjust  = r.static_hi_lo_adjust;
+            best_dynamic_hi_lo_adjust = r.dynamic_hi_lo_adjust;
+            best_rx_offset            = r.rx_offset;
+        } else {
+            Perf::Scope scope( perf, "sweep" );
+            if ( opt_hist ) {
+                hist_sweep<VLEVEL_CNT>( rx_mv, rx_stride, results );
+            } else {
+                sweep<VLEVEL_CNT>( rx_mv, rx_stride, results, stream.cache_key );
+            }
+            scope.count( "grid_points", results.size() );
+        }
+
+        //------------------------------------------------------------------
+        // Pick the best in the same order as a serial sweep would so that ties 
+        // resolve to the first grid point and the NEW BEST lines come out the same.
+        //------------------------------------------------------------------
+        for( size_t p = 0; p < results.size() / rx_stride; p++ )
         {
-            //------------------------------------------------------------------
-            // Try various Vt_HIGH/Vt_LOW adjustments when coming from extreme bits values.
-            //------------------------------------------------------------------
-            for( double dynamic_hi_lo_adjust = 0.0; dynamic_hi_lo_adjust <= Vt_HIGH/4; dynamic_hi_lo_adjust += 1.0 )
+            double static_hi_lo_adjust  = double(p / hi_lo_adjust_cnt) * hi_lo_adjust_step;
+            double dynamic_hi_lo_adjust = double(p % hi_lo_adjust_cnt) * hi_lo_adjust_step;
+            for( uint32_t rx_offset = 0; rx_offset < rx_stride; rx_offset++ )
             {
-                //------------------------------------------------------------------
-                // Try various RX time offsets.
-                //------------------------------------------------------------------
-                int  prev_chosen_bits = 1;
-                for( uint32_t rx_offset = 0; rx_offset < rx_stride; rx_offset++ )
-                {
-                    uint32_t cnt = 0;
-                    uint32_t above_noise_cnt = 0;
-                    uint32_t val_cnt[16];
-                    uint32_t val_above_noise_cnt[16];
-                    for( uint32_t i = 0; i < 16; i++ ) 
-                    {
-                        val_cnt[i] = 0;
-                        val_above_noise_cnt[i] = 0;
-                    }
-                    for( size_t i = rx_offset; i < rx_samples.size(); i += rx_stride )
-                    {
-                        bool ignore = i == rx_offset || i == (rx_offset+rx_stride);
-                        if ( !ignore ) cnt++;            // don't count start-up
-                        const Sample& sample = rx_samples[i];
-                        double vt;
-                        double margin;
-                        int bits = pam4( sample.iq_mv, vt, margin, static_hi_lo_adjust, prev_chosen_bits, dynamic_hi_lo_adjust );
-                        if ( !ignore ) val_cnt[bits]++;  // don't count start-up
-                        bool above_noise = margin > NOISE_mV_MAX;
-                        bool prev_above_noise = false;
-                        if ( rx_stride > 1 && i != 0 ) {
-                            const Sample& prev_sample = rx_samples[i-1];
-                            double prev_vt;
-                            double prev_margin;
-                            int prev_bits = pam4( prev_sample.iq_mv, prev_vt, prev_margin, static_hi_lo_adjust, prev_chosen_bits, dynamic_hi_lo_adjust );
-                            prev_above_noise = prev_bits == bits && prev_margin > NOISE_mV_MAX;
-                        }
-                        if ( !ignore && (above_noise || prev_above_noise) ) {
-                            above_noise_cnt++;
-                            val_above_noise_cnt[bits]++;
-                        }
-                        if ( debug ) printf( "RX: %5d %4d %1d %5d %4d %c\n", int(sample.time_ps), int(sample.iq_mv), bits, 
-                                             int(vt), int(margin), ignore ? 'x' : above_noise ? '+' : prev_above_noise ? '^' : '-' );
-                        prev_chosen_bits = bits;
-                    }
-                    double pct = double(above_noise_cnt) / double(cnt) * 100.0;
-                    for( uint32_t i = 0; i < 16; i++ ) 
-                    {
-                        if ( val_cnt[i] > 0 ) {
-                            double val_pct = double(val_above_noise_cnt[i]) / double(val_cnt[i]) * 100.0;
-                            if ( debug ) printf( "    %1d: above noise: %d of %d samples (%0.2f%%)\n", i, val_above_noise_cnt[i], val_cnt[i], val_pct );
-                        } 
-                    }
-                    if ( pct > best_pct ) {
-                        printf( "NEW BEST: rx_stride=%d static_hi_lo_adjust=%0.2f dynamic_hi_lo_adjust=%0.2f rx_offset=%d above noise: %d of %d samples (%0.2f%%)\n", 
-                                rx_stride, static_hi_lo_adjust, dynamic_hi_lo_adjust, rx_offset, above_noise_cnt, cnt, pct );
-                        best_pct                  = pct;
-                        best_static_hi_lo_adjust  = static_hi_lo_adjust;
-                        best_dynamic_hi_lo_adjust = dynamic_hi_lo_adjust;
-                        best_rx_offset            = rx_offset;
-                    }
+                const SweepResult& result = results[size_t(p)*rx_stride + rx_offset];
+                if ( result.pct > best_pct ) {
+                    printf( "NEW BEST: rx_stride=%d static_hi_lo_adjust=%0.2f dynamic_hi_lo_adjust=%0.2f rx_offset=%d above noise: %d of %d samples (%0.2f%%)\n", 
+                            rx_stride, static_hi_lo_adjust, dynamic_hi_lo_adjust, rx_offset, result.above_noise_cnt, result.cnt, result.pct );
+                    best_pct                  = result.pct;
+                    best_static_hi_lo_adjust  = static_hi_lo_adjust;
+                    best_dynamic_hi_lo_adjust = dynamic_hi_lo_adjust;
+                    best_rx_offset            = rx_offset;
                 }
             }
         }
@@ -359,21 +1890,23 @@ int main( int argc, const char * argv[] )
         //------------------------------------------------------------------
         // Show all RX samples with chosen Vts and rx_offsets.
         //------------------------------------------------------------------
+        Perf::Scope scope( perf, "dump" );
+        scope.count( "samples", rx_mv.size() );
         uint32_t next_chosen = best_rx_offset;
         int  prev_chosen_bits = 0;
         int  prev_bits = 0;
         bool prev_above_noise = false;
-        for( size_t i = 0; i < rx_samples.size(); i++ )
+        for( size_t i = 0; i < rx_mv.size(); i++ )
         {
-            const Sample& sample = rx_samples[i];
-            double vt;
-            double margin;
-            int bits = pam4( sample.iq_mv, vt, margin, best_static_hi_lo_adjust, prev_chosen_bits, best_dynamic_hi_lo_adjust );
+            const real mv = rx_mv[i];
+            real vt;
+            real margin;
+            int bits = pam<VLEVEL_CNT>( mv, vt, margin, best_static_hi_lo_adjust, prev_chosen_bits, best_dynamic_hi_lo_adjust );
             bool ignore    = i <= (best_rx_offset+rx_stride);
             bool is_chosen = i == next_chosen;
             bool above_noise = margin > NOISE_mV_MAX;
             if ( is_chosen ) next_chosen += rx_stride;
-            printf( "RX: %5d %4d %1d %5d %4d %c %s\n", int(sample.time_ps), int(sample.iq_mv), bits, 
+            printf( "RX: %5d %4d %1d %5d %4d %c %s\n", int(stream.sample_time_ps( i )), int(mv), bits, 
                     int(vt), int(margin), 
                     ignore ? 'x' : above_noise ? '+' : (is_chosen && prev_above_noise && prev_bits == bits) ? '^' : '-', 
                     ignore ? "(ignored)" : is_chosen ? "<===" : "" );
@@ -384,7 +1917,191 @@ int main( int argc, const char * argv[] )
 
         printf( "\nrx_stride=%d static_hi_lo_adjust=%0.2f dynamic_hi_lo_adjust=%0.2f rx_offset=%d had best above-noise percentage of %0.2f%%\n", 
                 rx_stride, best_static_hi_lo_adjust, best_dynamic_hi_lo_adjust, best_rx_offset, best_pct );
+        result_pct = best_pct;
+
+        if ( stat_eye ) {
+            Perf::Scope stat_scope( perf, "stat" );
+            stat_rx<VLEVEL_CNT>( stream, rx_stride, best_rx_offset, best_static_hi_lo_adjust, best_dynamic_hi_lo_adjust );
+            stat_scope.count( "samples", rx_mv.size() );
+        }
+    }
+    return result_pct;
+}
+
+int main( int argc, const char * argv[] )
+{
+    if ( argc < 2 ) die( "usage: analyze <raw_file>|<qam_bin_file> [-threads <cnt>] [-opt grid|hist|adapt] [-step <mV>] [-window <rx_samples>] [-slicer batch|scalar] "
+                           "[-qam 4|16|64|256] [-channel_len <mm>] [-channel_step <raw_file>] [-eye <file>|<file>.pgm] [-perf <json_file>|-] "
+                           "[-adjust_max <mV>] [-cache <dir>] "
+                           "[-rx_ghz <ghz>[@<phase_ps>],...] [-interp linear|cubic] [-stat]" );
+    std::string raw_file = std::string( argv[1] );
+    for( int i = 2; i < argc; i++ )
+    {
+        std::string arg = argv[i];
+        if ( arg == "-threads" && (i+1) < argc ) {
+            thread_cnt = std::atoi( argv[++i] );
+        } else if ( arg == "-opt" && (i+1) < argc ) {
+            std::string opt = argv[++i];
+            if ( opt != "grid" && opt != "hist" && opt != "adapt" ) die( "-opt must be grid, hist, or adapt" );
+            opt_hist  = opt == "hist";
+            opt_adapt = opt == "adapt";
+        } else if ( arg == "-step" && (i+1) < argc ) {
+            hi_lo_adjust_step = std::atof( argv[++i] );
+            if ( hi_lo_adjust_step <= 0.0 ) die( "-step must be positive" );
+        } else if ( arg == "-adjust_max" && (i+1) < argc ) {
+            hi_lo_adjust_range = std::atof( argv[++i] );
+            if ( hi_lo_adjust_range <= 0.0 ) die( "-adjust_max must be positive" );
+        } else if ( arg == "-rx_ghz" && (i+1) < argc ) {
+            std::istringstream rates( argv[++i] );
+            std::string rate;
+            while( std::getline( rates, rate, ',' ) )
+            {
+                size_t at = rate.find( '@' );
+                rx_streams.push_back( rx_stream( std::atof( rate.substr( 0, at ).c_str() ), 
+                                                 (at == std::string::npos) ? 0.0 : std::atof( rate.substr( at+1 ).c_str() ) ) );
+            }
+        } else if ( arg == "-interp" && (i+1) < argc ) {
+            std::string interp = argv[++i];
+            if ( interp != "linear" && interp != "cubic" ) die( "-interp must be linear or cubic" );
+            interp_cubic = interp == "cubic";
+        } else if ( arg == "-stat" ) {
+            stat_eye = true;
+        } else if ( arg == "-cache" && (i+1) < argc ) {
+            cache_dir = argv[++i];
+        } else if ( arg == "-window" && (i+1) < argc ) {
+            rx_window = std::atoll( argv[++i] );
+        } else if ( arg == "-slicer" && (i+1) < argc ) {
+            std::string slicer = argv[++i];
+            if ( slicer != "batch" && slicer != "scalar" ) die( "-slicer must be batch or scalar" );
+            use_batch_slicer = slicer == "batch";
+        } else if ( arg == "-channel_len" && (i+1) < argc ) {
+            channel_len_m = std::atof( argv[++i] ) * 1.0e-3;     // "10" or "10m" (10mm, as for out2sp)
+            if ( channel_len_m <= 0.0 ) die( "-channel_len must be positive" );
+        } else if ( arg == "-qam" && (i+1) < argc ) {
+            uint32_t n = std::atoi( argv[++i] );
+            vlevel_cnt = uint32_t( std::lround( std::sqrt( double(n) ) ) );
+            if ( vlevel_cnt*vlevel_cnt != n || !qam_order_ok( vlevel_cnt ) ) die( "-qam must be 4, 16, 64, or 256" );
+        } else if ( arg == "-perf" && (i+1) < argc ) {
+            perf_file    = argv[++i];
+            perf.enabled = true;
+        } else if ( arg == "-eye" && (i+1) < argc ) {
+            eye_file = argv[++i];
+        } else if ( arg == "-channel_step" && (i+1) < argc ) {
+            channel_step_file = argv[++i];
+        } else {
+            die( "unknown option: " + arg );
+        }
+    }
+
+    //------------------------------------------------------------------
+    // Stream the iq_tx and iq_rx values of the transient plot (or of the 
+    // channel model for a qam -out bin file) and sample them at their periods 
+    // as they go by.  Only the RX samples are kept, so memory depends on the 
+    // symbol count rather than the number of SPICE timesteps.  With -window, 
+    // only the last rx_window RX samples are kept.
+    //
+    // The number of voltage levels comes from -qam, else from the qam -out bin 
+    // header, else it is PAM4 (16-QAM, which is what out2sp decks have).
+    //
+    // With -eye, the whole RX waveform (not just the -window) also goes into 
+    // an eye diagram, which is measured and written out here.
+    //
+    // Each -rx_ghz rate (and phase) is its own stream of RX samples from 
+    // the same pass, and is swept separately.
+    //
+    // With -cache, the RX samples come from the cache if this input was 
+    // already sampled with the same settings (except with -eye).
+    //------------------------------------------------------------------
+    if ( rx_streams.empty() ) rx_streams.push_back( rx_stream( RX_CLK_GHZ, 0.0 ) );
+    uint64_t raw_file_hash = (cache_dir != "") ? hash_file( raw_file, 0 ) : 0;
+    for( auto& stream : rx_streams )
+    {
+        if ( cache_dir != "" ) stream.cache_key = samples_cache_key( raw_file_hash, stream );
+        if ( rx_window != 0 ) stream.mv.reserve( 2*rx_window );
+    }
+    std::unique_ptr<EyeDiagram> eye( (eye_file != "") ? new EyeDiagram : nullptr );
+    auto sample = [&]( auto& source )
+    {
+        Perf::Scope scope( perf, "sample" );    // entry parsing and TX/RX resampling are one streaming pass
+        uint64_t entry_cnt = qam_dispatch( vlevel_cnt, [&]( auto l ) { return sample_rx<decltype(l)::value>( source, rx_streams, eye.get() ); } );
+        scope.count( "entries", entry_cnt );
+        size_t sample_cnt = 0;
+        for( const auto& stream : rx_streams ) sample_cnt += stream.mv.size();
+        scope.count( "samples", sample_cnt );
+    };
+    uint32_t cached_vlevel_cnt = 0;
+    bool     cached = cache_dir != "" && !eye;
+    for( size_t s = 0; cached && s < rx_streams.size(); s++ )
+    {
+        uint32_t level_cnt = 0;
+        cached = load_samples( rx_streams[s].cache_key, rx_streams[s], level_cnt ) && (s == 0 || level_cnt == cached_vlevel_cnt);
+        cached_vlevel_cnt = level_cnt;
+    }
+    if ( cached ) {
+        vlevel_cnt = cached_vlevel_cnt;
+        for( const auto& stream : rx_streams )
+        {
+            std::cout << "CACHE: " << stream.mv.size() << " RX samples from " << cache_path( stream.cache_key, ".samples" ) << "\n";
+        }
+    } else if ( is_qam_bin( raw_file ) ) {
+        Perf::Scope open_scope( perf, "open" );
+        Channel channel = make_channel();
+        QamBinSource source( raw_file, channel );
+        if ( vlevel_cnt == 0 ) vlevel_cnt = source.level_cnt();
+        open_scope.stop();
+        for( auto& stream : rx_streams ) 
+        {
+            stream.mv.clear();
+            stream.first_i = 0;
+        }
+        sample( source );
+    } else {
+        Perf::Scope open_scope( perf, "open" );
+        RawFile raw( raw_file );                 // unmapped at the end of this block
+        if ( vlevel_cnt == 0 ) vlevel_cnt = VLEVEL_CNT_DEFAULT;
+        open_scope.stop();
+        for( auto& stream : rx_streams ) 
+        {
+            stream.mv.clear();
+            stream.first_i = 0;
+        }
+        sample( raw );
+    }
+    for( auto& stream : rx_streams )
+    {
+        std::vector<real_store>& rx_mv = stream.mv;
+        if ( rx_window != 0 && rx_mv.size() > rx_window ) {
+            stream.first_i += rx_mv.size() - rx_window;
+            rx_mv.erase( rx_mv.begin(), rx_mv.end() - rx_window );
+        }
+        if ( cache_dir != "" && !cached ) save_samples( stream.cache_key, stream, vlevel_cnt );
+    }
+    if ( eye ) {
+        Perf::Scope scope( perf, "eye" );
+        std::vector<EyeOpening> openings = eye->openings( vlevel_cnt );
+        for( uint32_t k = 0; k < openings.size(); k++ )
+        {
+            const EyeOpening& o = openings[k];
+            printf( "EYE: opening=%d height=%0.2f mV width=%0.2f ps center=%0.2f mV at %0.2f ps\n", 
+                    k, o.height_mv, o.width_ps, o.center_mv, o.center_ps );
+        }
+        eye->write( eye_file, openings );
+    }
+
+    if ( hi_lo_adjust_range == 0.0 ) hi_lo_adjust_range = hi_lo_adjust_max( vlevel_cnt );
+    hi_lo_adjust_cnt = uint32_t(hi_lo_adjust_range / hi_lo_adjust_step) + 1;
+    std::vector<double> best_pcts;
+    for( const auto& stream : rx_streams )
+    {
+        if ( rx_streams.size() > 1 ) printf( "\nRATE: rx_ghz=%0.2f phase_ps=%0.2f rx_stride=%d\n", stream.ghz, stream.phase_ps, stream.stride );
+        best_pcts.push_back( qam_dispatch( vlevel_cnt, [&]( auto l ) { return analyze_rx<decltype(l)::value>( stream ); } ) );
+    }
+    for( size_t s = 0; rx_streams.size() > 1 && s < rx_streams.size(); s++ )
+    {
+        printf( "%sRATES: rx_ghz=%0.2f phase_ps=%0.2f rx_stride=%d had best above-noise percentage of %0.2f%%\n", (s == 0) ? "\n" : "",
+                rx_streams[s].ghz, rx_streams[s].phase_ps, rx_streams[s].stride, best_pcts[s] );
     }
 
+    if ( perf.enabled && !perf.write_json( "analyze", perf_file ) ) die( "could not write " + perf_file );
     return 0;
 }
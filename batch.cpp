@@ -0,0 +1,345 @@
+// Copyright (c) 2014-2019 Robert A. Alfieri
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// batch.c - run qam -> [ngspice] -> analyze for many seeds in parallel and aggregate the results
+//
+#include <cstdint>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include "stdlib.h"
+
+// config
+static uint32_t    seed_first  = 0xb0b1cafe;
+static uint32_t    seed_cnt    = 16;
+static uint32_t    job_cnt     = 0;             // -jobs: concurrent seeds (0 means std::thread::hardware_concurrency())
+static uint32_t    spice_cnt   = 0;             // -spice_jobs: concurrent ngspice runs (0 means job_cnt)
+static uint32_t    clk_cnt     = 256;           // -clk_cnt: clocks per seed
+static std::string channel     = "spice";       // -channel spice|model
+static std::string line_len    = "10m";         // -line_len (10mm, not 10 meters)
+static std::string analyze_args = "";           // -analyze_args: passed through to analyze
+static bool        keep        = false;         // -keep: keep each seed's files
+
+void die( std::string msg )
+{
+    std::cout << "ERROR: " << msg << "\n";
+    exit( 1 );
+}
+
+//------------------------------------------------------------------
+// Seeds start out split evenly across the workers' queues.  A worker takes 
+// from the front of its own queue and, when that is empty, steals from the 
+// back of the others', so seeds that take longer (e.g., a slow SPICE run) 
+// don't leave the other workers idle at the end.
+//------------------------------------------------------------------
+class WorkPool
+{
+public:
+    WorkPool( uint32_t worker_cnt, uint32_t first, uint32_t cnt );
+
+    bool pop( uint32_t w, uint32_t& seed );     // returns false when all queues are empty
+
+private:
+    struct Queue
+    {
+        std::mutex           mutex;
+        std::deque<uint32_t> seeds;
+    };
+    std::vector<Queue> queues;
+};
+
+WorkPool::WorkPool( uint32_t worker_cnt, uint32_t first, uint32_t cnt ) : queues( worker_cnt )
+{
+    for( uint32_t i = 0; i < cnt; i++ )
+    {
+        queues[uint64_t(i) * worker_cnt / cnt].seeds.push_back( first + i );
+    }
+}
+
+bool WorkPool::pop( uint32_t w, uint32_t& seed )
+{
+    {
+        std::lock_guard<std::mutex> lock( queues[w].mutex );
+        if ( !queues[w].seeds.empty() ) {
+            seed = queues[w].seeds.front();
+            queues[w].seeds.pop_front();
+            return true;
+        }
+    }
+    for( uint32_t i = 1; i < queues.size(); i++ )
+    {
+        Queue& victim = queues[(w + i) % queues.size()];
+        std::lock_guard<std::mutex> lock( victim.mutex );
+        if ( !victim.seeds.empty() ) {
+            seed = victim.seeds.back();
+            victim.seeds.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+//------------------------------------------------------------------
+// Counting semaphore for the external simulator jobs.
+//------------------------------------------------------------------
+class Semaphore
+{
+public:
+    Semaphore( uint32_t cnt_ ) : cnt( cnt_ ) {}
+    void acquire( void ) { std::unique_lock<std::mutex> lock( mutex ); cv.wait( lock, [this] { return cnt > 0; } ); cnt--; }
+    void release( void ) { { std::lock_guard<std::mutex> lock( mutex ); cnt++; } cv.notify_one(); }
+
+private:
+    std::mutex              mutex;
+    std::condition_variable cv;
+    uint32_t                cnt;
+};
+
+//------------------------------------------------------------------
+// What we keep from each seed's qam and analyze output.
+//------------------------------------------------------------------
+struct SeedResult
+{
+    uint32_t seed;
+    bool     ok                   = false;
+    std::string err;
+    double   eye_width_ps_min     = 0.0;
+    double   eye_width_ps_max     = 0.0;
+    double   eye_width_ps_avg     = 0.0;
+    double   static_hi_lo_adjust  = 0.0;
+    double   dynamic_hi_lo_adjust = 0.0;
+    uint32_t rx_offset            = 0;
+    double   pct                  = 0.0;
+};
+
+// running distribution of one value
+struct Dist
+{
+    std::vector<double> vals;
+
+    void   add( double v ) { vals.push_back( v ); }
+    double pctile( double p ) const;            // vals must be sorted
+    void   print( std::string name );
+};
+
+double Dist::pctile( double p ) const
+{
+    size_t i = size_t( p * double(vals.size()-1) + 0.5 );
+    return vals[i];
+}
+
+void Dist::print( std::string name )
+{
+    if ( vals.empty() ) return;
+    std::sort( vals.begin(), vals.end() );
+    double sum = 0.0;
+    for( double v : vals ) sum += v;
+    double avg = sum / double(vals.size());
+    double var = 0.0;
+    for( double v : vals ) var += (v - avg) * (v - avg);
+    double stddev = std::sqrt( var / double(vals.size()) );
+    printf( "%-22s min=%8.2f p5=%8.2f median=%8.2f avg=%8.2f p95=%8.2f max=%8.2f stddev=%7.2f\n", 
+            name.c_str(), vals.front(), pctile( 0.05 ), pctile( 0.5 ), avg, pctile( 0.95 ), vals.back(), stddev );
+}
+
+//------------------------------------------------------------------
+// Run a command and hand each line of its stdout to on_line.
+// Returns false if it could not be run or exited with an error.
+//------------------------------------------------------------------
+template<typename F>
+bool run( std::string cmd, F on_line )
+{
+    FILE * f = popen( (cmd + " 2>&1").c_str(), "r" );
+    if ( f == nullptr ) return false;
+    char buf[4096];
+    while( fgets( buf, sizeof( buf ), f ) != nullptr ) on_line( buf );
+    return pclose( f ) == 0;
+}
+
+SeedResult run_seed( uint32_t seed, Semaphore& spice_sem )
+{
+    SeedResult r;
+    r.seed = seed;
+    std::string base   = "qam" + std::to_string( seed );
+    std::string basell = base + "." + line_len;
+    bool        model  = channel == "model";
+
+    //------------------------------------------------------------------
+    // qam
+    //------------------------------------------------------------------
+    std::string cmd = "./qam " + std::to_string( seed ) + " " + std::to_string( clk_cnt ) + 
+                      (model ? (" -out bin -out_file " + base + ".bin") : 
+                               (" -out sp -line_len " + line_len + " -out_file " + basell + ".sp"));
+    uint32_t found = 0;
+    bool ok = run( cmd, [&]( const char * line ) 
+    {
+        if ( sscanf( line, "eye_width min..max = %lf ps .. %lf ps", &r.eye_width_ps_min, &r.eye_width_ps_max ) == 2 ) found |= 1;
+        if ( sscanf( line, "eye_width avg = %lf ps", &r.eye_width_ps_avg ) == 1 ) found |= 2;
+    } );
+    if ( !ok || found != 3 ) { r.err = "qam failed: " + cmd; return r; }
+
+    //------------------------------------------------------------------
+    // ngspice, at most spice_cnt at a time
+    //------------------------------------------------------------------
+    if ( !model ) {
+        spice_sem.acquire();
+        cmd = "./out2sp " + line_len + " " + base + " ngspice " + basell + " binary qam";
+        ok = run( cmd, []( const char * ) {} );
+        spice_sem.release();
+        if ( !ok ) { r.err = "out2sp failed: " + cmd; return r; }
+    }
+
+    //------------------------------------------------------------------
+    // analyze
+    //------------------------------------------------------------------
+    cmd = "./analyze " + (model ? (base + ".bin -channel_len " + line_len) : (basell + ".raw")) + 
+          " -threads 1 " + analyze_args;
+    found = 0;
+    ok = run( cmd, [&]( const char * line ) 
+    {
+        uint32_t rx_stride;
+        if ( sscanf( line, "rx_stride=%u static_hi_lo_adjust=%lf dynamic_hi_lo_adjust=%lf rx_offset=%u had best above-noise percentage of %lf", 
+                     &rx_stride, &r.static_hi_lo_adjust, &r.dynamic_hi_lo_adjust, &r.rx_offset, &r.pct ) == 5 ) found = 1;
+    } );
+    if ( !ok || found != 1 ) { r.err = "analyze failed: " + cmd; return r; }
+
+    if ( !keep ) {
+        std::string files = model ? (base + ".bin") : (basell + ".sp " + basell + ".raw " + basell + ".out " + basell + ".*.eps");
+        run( "rm -f " + files, []( const char * ) {} );
+    }
+    r.ok = true;
+    return r;
+}
+
+int main( int argc, const char * argv[] )
+{
+    uint32_t pos_i = 0;
+    for( int i = 1; i < argc; i++ )
+    {
+        std::string arg = argv[i];
+        if ( arg == "-jobs" && (i+1) < argc ) {
+            job_cnt = std::atoi( argv[++i] );
+        } else if ( arg == "-spice_jobs" && (i+1) < argc ) {
+            spice_cnt = std::atoi( argv[++i] );
+        } else if ( arg == "-clk_cnt" && (i+1) < argc ) {
+            clk_cnt = std::atoi( argv[++i] );
+        } else if ( arg == "-channel" && (i+1) < argc ) {
+            channel = argv[++i];
+            if ( channel != "spice" && channel != "model" ) die( "-channel must be spice or model" );
+        } else if ( arg == "-line_len" && (i+1) < argc ) {
+            line_len = argv[++i];
+            if ( line_len.empty() || line_len.back() != 'm' ) line_len += "m";
+        } else if ( arg == "-analyze_args" && (i+1) < argc ) {
+            analyze_args = argv[++i];
+        } else if ( arg == "-keep" ) {
+            keep = true;
+        } else if ( arg[0] != '-' && pos_i == 0 ) {
+            seed_first = std::strtoul( argv[i], nullptr, 0 );
+            pos_i++;
+        } else if ( arg[0] != '-' && pos_i == 1 ) {
+            seed_cnt = std::atoi( argv[i] );
+            pos_i++;
+        } else {
+            die( "usage: batch [seed_first [seed_cnt]] [-jobs <cnt>] [-spice_jobs <cnt>] [-clk_cnt <cnt>] [-channel spice|model] "
+                 "[-line_len <len>] [-analyze_args <args>] [-keep]" );
+        }
+    }
+    if ( job_cnt == 0 ) job_cnt = std::thread::hardware_concurrency();
+    if ( job_cnt == 0 ) job_cnt = 1;
+    if ( spice_cnt == 0 ) spice_cnt = job_cnt;
+    if ( seed_cnt == 0 ) die( "seed_cnt must be positive" );
+    job_cnt = std::min( job_cnt, seed_cnt );
+
+    //------------------------------------------------------------------
+    // Each worker runs whole seeds.  Per-seed lines are printed as seeds finish.
+    //------------------------------------------------------------------
+    auto start = std::chrono::steady_clock::now();
+    WorkPool                 pool( job_cnt, seed_first, seed_cnt );
+    Semaphore                spice_sem( spice_cnt );
+    std::mutex               results_mutex;
+    std::vector<SeedResult>  results;
+    std::vector<std::thread> workers;
+    for( uint32_t w = 0; w < job_cnt; w++ )
+    {
+        workers.push_back( std::thread( [&, w]() 
+        {
+            uint32_t seed;
+            while( pool.pop( w, seed ) )
+            {
+                SeedResult r = run_seed( seed, spice_sem );
+                std::lock_guard<std::mutex> lock( results_mutex );
+                if ( r.ok ) {
+                    printf( "seed=%u eye_width_min=%g eye_width_avg=%g eye_width_max=%g static_hi_lo_adjust=%0.2f dynamic_hi_lo_adjust=%0.2f rx_offset=%u pct=%0.2f\n",
+                            r.seed, r.eye_width_ps_min, r.eye_width_ps_avg, r.eye_width_ps_max, 
+                            r.static_hi_lo_adjust, r.dynamic_hi_lo_adjust, r.rx_offset, r.pct );
+                } else {
+                    printf( "seed=%u ERROR: %s\n", r.seed, r.err.c_str() );
+                }
+                fflush( stdout );
+                results.push_back( r );
+            }
+        } ) );
+    }
+    for( auto& t : workers ) t.join();
+    double secs = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+
+    //------------------------------------------------------------------
+    // Aggregate.
+    //------------------------------------------------------------------
+    Dist eye_min, eye_avg, eye_max, pct;
+    std::map<double, uint32_t> static_cnts, dynamic_cnts;
+    std::map<uint32_t, uint32_t> rx_offset_cnts;
+    uint32_t ok_cnt = 0;
+    for( const auto& r : results )
+    {
+        if ( !r.ok ) continue;
+        ok_cnt++;
+        eye_min.add( r.eye_width_ps_min );
+        eye_avg.add( r.eye_width_ps_avg );
+        eye_max.add( r.eye_width_ps_max );
+        pct.add( r.pct );
+        static_cnts[r.static_hi_lo_adjust]++;
+        dynamic_cnts[r.dynamic_hi_lo_adjust]++;
+        rx_offset_cnts[r.rx_offset]++;
+    }
+    printf( "\n%u of %u seeds succeeded in %0.1f s (%0.1f seeds/min) with %u jobs\n\n", ok_cnt, seed_cnt, secs, 60.0 * double(seed_cnt) / secs, job_cnt );
+    eye_min.print( "eye_width_min (ps)" );
+    eye_avg.print( "eye_width_avg (ps)" );
+    eye_max.print( "eye_width_max (ps)" );
+    pct.print(     "above-noise pct" );
+    printf( "\nbest static_hi_lo_adjust:  " );
+    for( const auto& c : static_cnts ) printf( " %0.2f:%u", c.first, c.second );
+    printf( "\nbest dynamic_hi_lo_adjust: " );
+    for( const auto& c : dynamic_cnts ) printf( " %0.2f:%u", c.first, c.second );
+    printf( "\nbest rx_offset:            " );
+    for( const auto& c : rx_offset_cnts ) printf( " %u:%u", c.first, c.second );
+    printf( "\n" );
+    return (ok_cnt == seed_cnt) ? 0 : 1;
+}
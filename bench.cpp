@@ -0,0 +1,349 @@
+// Copyright (c) 2014-2019 Robert A. Alfieri
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// bench.cpp - microbenchmarks of the qam and analyze kernels, with a baseline to catch slowdowns
+//
+// The kernels timed are the real ones: analyze.cpp and qam.cpp are compiled into 
+// this program with their main()s renamed.  qam.cpp goes in its own namespace because 
+// both files have file-scope globals with the same names (debug, thread_cnt, perf, ...).
+// All inputs are synthetic and come from fixed seeds, so every run does the same work.
+//
+// Each kernel is timed BENCH_REP_CNT times, each time running it over and over 
+// for at least BENCH_REP_MIN_S, and the fastest rate is reported as items per second.  
+// With -save, the rates are written to a baseline file; with -baseline, they are 
+// compared against one and any kernel that is more than -tolerance percent slower 
+// is flagged and makes the exit status 1.
+//
+#include <cstdint>
+#include <string>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <bitset>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include "stdlib.h"
+
+#define main analyze_main
+#include "analyze.cpp"
+#undef main
+
+namespace qam_sim
+{
+#define main qam_main
+#include "qam.cpp"
+#undef main
+}
+
+// config constants
+static constexpr uint32_t BENCH_REP_CNT       = 5;
+static constexpr double   BENCH_REP_MIN_S     = 0.05;
+static constexpr uint64_t BENCH_SEED          = 0xb0b1cafe;
+static constexpr uint32_t BENCH_SIM_CLK_CNT   = 1 << 20;   // symbols generated by sim
+static constexpr uint32_t BENCH_BUS_LANE_CNT  = 64;        // lanes in the sim_bus bus
+static constexpr uint32_t BENCH_BUS_CLK_CNT   = 1 << 14;   // clocks of the sim_bus bus
+static constexpr uint32_t BENCH_SAMPLE_CNT    = 1 << 20;   // RX samples sliced by pam4 and slice_batch
+static constexpr uint32_t BENCH_RAW_POINT_CNT = 1 << 18;   // points in the synthetic .raw files
+static constexpr uint32_t BENCH_ENTRY_CNT     = 1 << 21;   // entries resampled
+static constexpr uint32_t BENCH_SWEEP_CNT     = 1 << 14;   // RX samples swept (x the whole grid)
+static constexpr double   BENCH_TOLERANCE_PCT = 10.0;
+
+struct BenchResult
+{
+    std::string name;
+    std::string unit;
+    uint64_t    items;                  // per run
+    double      best_s;                 // per run
+    double      rate;                   // items per second
+};
+
+//------------------------------------------------------------------
+// Time f() BENCH_REP_CNT times and keep the fastest.  f() returns a checksum,
+// which is accumulated so that the compiler can't drop the work.
+//------------------------------------------------------------------
+static uint64_t checksum = 0;
+
+template<typename F>
+BenchResult bench( std::string name, std::string unit, uint64_t items, F f )
+{
+    double best_s = 1e30;
+    for( uint32_t r = 0; r < BENCH_REP_CNT; r++ )
+    {
+        auto     start   = std::chrono::steady_clock::now();
+        uint32_t run_cnt = 0;
+        double   s       = 0.0;
+        do
+        {
+            checksum += f();
+            run_cnt++;
+            s = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        } while( s < BENCH_REP_MIN_S );
+        best_s = std::min( best_s, s / double(run_cnt) );
+    }
+    return BenchResult{ name, unit, items, best_s, double(items) / best_s };
+}
+
+// synthetic RX voltages: PAM4 levels plus uniform noise, from a fixed seed
+std::vector<real> synthetic_rx_mv( uint32_t cnt )
+{
+    std::vector<real> mv( cnt );
+    for( uint32_t i = 0; i < cnt; i++ )
+    {
+        uint64_t r = qam_sim::splitmix64( BENCH_SEED + i );
+        double level = double(int(2*(r & 3)) - 3) * RX_mV_MAX / 3.0;
+        double noise = (double((r >> 8) & 0xffff) / 65535.0 - 0.5) * 2.0 * 50.0;
+        mv[i] = level + noise;
+    }
+    return mv;
+}
+
+// synthetic RX waveform: PAM4 symbols at the TX rate with linear transitions, at 1 ps
+std::vector<Entry> synthetic_entries( uint32_t cnt )
+{
+    std::vector<Entry> entries( cnt );
+    const uint32_t ui_cnt = uint32_t(TX_CLK_PERIOD_PS);
+    double prev_mv = 0.0;
+    double mv      = 0.0;
+    for( uint32_t i = 0; i < cnt; i++ )
+    {
+        if ( (i % ui_cnt) == 0 ) {
+            prev_mv = mv;
+            mv = double(int(2*(qam_sim::splitmix64( BENCH_SEED + i/ui_cnt ) & 3)) - 3) * RX_mV_MAX / 3.0;
+        }
+        double a = std::min( 1.0, double(i % ui_cnt) / double(ui_cnt/2) );
+        entries[i] = Entry{ int64_t(i), double(i), mv, a*mv + (1.0-a)*prev_mv };
+    }
+    return entries;
+}
+
+// Entry source over a vector, for sample_rx()
+class VectorSource
+{
+public:
+    VectorSource( const std::vector<Entry>& entries_ ) : entries( entries_ ), i( 0 ) {}
+    bool next( Entry& entry ) { if ( i == entries.size() ) return false; entry = entries[i++]; return true; }
+
+private:
+    const std::vector<Entry>& entries;
+    size_t                    i;
+};
+
+//------------------------------------------------------------------
+// Synthetic SPICE .raw file with the variables in out2sp's .save order.
+//------------------------------------------------------------------
+void write_synthetic_raw( std::string path, bool binary, const std::vector<Entry>& entries, uint32_t cnt )
+{
+    std::ofstream out( path, std::ios::binary );
+    if ( !out.is_open() ) die( "could not open " + path + " for output" );
+    out << "Title: bench\nDate: -\nPlotname: Transient Analysis\nFlags: real\n";
+    out << "No. Variables: 5\nNo. Points: " << cnt << "\n";
+    out << "Variables:\n\t0\ttime\ttime\n\t1\tv(i_clk)\tvoltage\n\t2\tv(q_clk)\tvoltage\n\t3\tv(iq_clk)\tvoltage\n\t4\tv(iq_clk_rx)\tvoltage\n";
+    out << (binary ? "Binary:\n" : "Values:\n");
+    out << std::setprecision( 15 );
+    for( uint32_t i = 0; i < cnt; i++ )
+    {
+        const Entry& e = entries[i];
+        double v[5] = { e.time_ps * 1e-12, 0.0, 0.0, e.iq_tx_mv / 500.0, e.iq_rx_mv / 1000.0 };
+        if ( binary ) {
+            out.write( reinterpret_cast<const char *>( v ), sizeof( v ) );
+        } else {
+            out << " " << i << "\t" << v[0] << "\n";
+            for( uint32_t k = 1; k < 5; k++ ) out << "\t" << v[k] << "\n";
+        }
+    }
+    if ( !out ) die( "could not write " + path );
+}
+
+int main( int argc, const char * argv[] )
+{
+    std::string save_file     = "";
+    std::string baseline_file = "";
+    double      tolerance_pct = BENCH_TOLERANCE_PCT;
+    for( int i = 1; i < argc; i++ )
+    {
+        std::string arg = argv[i];
+        if ( arg == "-save" && (i+1) < argc ) {
+            save_file = argv[++i];
+        } else if ( arg == "-baseline" && (i+1) < argc ) {
+            baseline_file = argv[++i];
+        } else if ( arg == "-tolerance" && (i+1) < argc ) {
+            tolerance_pct = std::atof( argv[++i] );
+        } else {
+            die( "usage: bench [-save <baseline_file>] [-baseline <baseline_file>] [-tolerance <pct>]" );
+        }
+    }
+
+    // everything runs on one thread so that rates compare across machines with different core counts
+    thread_cnt          = 1;
+    qam_sim::thread_cnt = 1;
+    qam_sim::out_mode   = qam_sim::OutMode::SUMMARY;
+    qam_sim::rng_key    = BENCH_SEED;
+
+    std::vector<BenchResult> results;
+
+    //------------------------------------------------------------------
+    // qam: symbol generation and eye stats (sim_range() is all of sim() with one thread)
+    //------------------------------------------------------------------
+    results.push_back( bench( "sim", "symbols", BENCH_SIM_CLK_CNT, [&]( void ) 
+    {
+        std::ostream      null_out( nullptr );
+        qam_sim::EyeStats stats;
+        qam_sim::sim_range<N_SQRT_DEFAULT>( 0, BENCH_SIM_CLK_CNT, null_out, stats );
+        return stats.eye_ts_cnt_tot;
+    } ) );
+
+    qam_sim::lane_cnt = BENCH_BUS_LANE_CNT;
+    results.push_back( bench( "sim_bus", "lane_clocks", uint64_t(BENCH_BUS_LANE_CNT) * BENCH_BUS_CLK_CNT, [&]( void ) 
+    {
+        std::vector<qam_sim::EyeStats> stats( BENCH_BUS_LANE_CNT );
+        qam_sim::sim_bus_range<N_SQRT_DEFAULT>( 0, BENCH_BUS_CLK_CNT, stats );
+        uint64_t sum = 0;
+        for( const auto& st : stats ) sum += st.eye_ts_cnt_tot;
+        return sum;
+    } ) );
+
+    //------------------------------------------------------------------
+    // analyze: PAM4 slicing, scalar and batch
+    //------------------------------------------------------------------
+    const std::vector<real> rx_mv = synthetic_rx_mv( BENCH_SAMPLE_CNT );
+    results.push_back( bench( "pam4", "samples", BENCH_SAMPLE_CNT, [&]( void ) 
+    {
+        uint64_t sum  = 0;
+        int      bits = 1;
+        for( uint32_t i = 0; i < BENCH_SAMPLE_CNT; i++ )
+        {
+            real vt;
+            real margin;
+            bits = pam<4>( rx_mv[i], vt, margin, 5.0, bits, 10.0 );
+            sum += uint64_t(bits) + uint64_t(margin > NOISE_mV_MAX);
+        }
+        return sum;
+    } ) );
+
+    std::vector<uint16_t> codes( BENCH_SAMPLE_CNT );
+    results.push_back( bench( "slice_batch", "samples", BENCH_SAMPLE_CNT, [&]( void ) 
+    {
+        const SliceVts svts = slice_vts( 5.0, 10.0 );
+        slice_batch( rx_mv.data() + 1, rx_mv.data(), BENCH_SAMPLE_CNT-1, svts, codes.data() );
+        uint64_t sum = 0;
+        for( uint32_t i = 0; i < BENCH_SAMPLE_CNT-1; i++ ) sum += codes[i];
+        return sum;
+    } ) );
+
+    //------------------------------------------------------------------
+    // analyze: .raw parsing, ASCII and binary
+    //------------------------------------------------------------------
+    const std::vector<Entry> entries = synthetic_entries( std::max( BENCH_ENTRY_CNT, BENCH_RAW_POINT_CNT ) );
+    for( bool binary : { false, true } )
+    {
+        std::string path = binary ? "bench.binary.raw" : "bench.ascii.raw";
+        write_synthetic_raw( path, binary, entries, BENCH_RAW_POINT_CNT );
+        results.push_back( bench( binary ? "raw_parse_binary" : "raw_parse_ascii", "entries", BENCH_RAW_POINT_CNT, [&]( void ) 
+        {
+            RawFile  raw( path );
+            Entry    entry;
+            uint64_t sum = 0;
+            while( raw.next( entry ) ) sum += uint64_t(entry.index);
+            return sum;
+        } ) );
+        std::remove( path.c_str() );
+    }
+
+    //------------------------------------------------------------------
+    // analyze: TX/RX resampling of a waveform
+    //------------------------------------------------------------------
+    results.push_back( bench( "resample", "entries", BENCH_ENTRY_CNT, [&]( void ) 
+    {
+        VectorSource        source( entries );
+        std::vector<real_store> rx_samples;
+        sample_rx<4>( source, rx_samples, nullptr );
+        return uint64_t(rx_samples.size());
+    } ) );
+
+    //------------------------------------------------------------------
+    // analyze: the full threshold sweep with the default grid, batch slicer
+    //------------------------------------------------------------------
+    std::vector<real_store> sweep_samples;
+    {
+        std::vector<Entry> sweep_entries( entries.begin(), entries.begin() + uint64_t(BENCH_SWEEP_CNT) * uint64_t(RX_CLK_PERIOD_PS) );
+        VectorSource source( sweep_entries );
+        sample_rx<4>( source, sweep_samples, nullptr );
+    }
+    hi_lo_adjust_cnt = uint32_t(hi_lo_adjust_max( 4 ) / hi_lo_adjust_step) + 1;
+    const uint32_t rx_stride   = RX_CLK_GHZ / TX_CLK_GHZ;
+    const uint64_t grid_pt_cnt = uint64_t(hi_lo_adjust_cnt) * hi_lo_adjust_cnt * rx_stride;
+    results.push_back( bench( "sweep", "grid_points", grid_pt_cnt, [&]( void ) 
+    {
+        std::vector<SweepResult> sweep_results;
+        sweep<4>( sweep_samples, rx_stride, sweep_results, 0 );
+        uint64_t sum = 0;
+        for( const auto& r : sweep_results ) sum += r.above_noise_cnt;
+        return sum;
+    } ) );
+
+    //------------------------------------------------------------------
+    // Report, compare, save.
+    //------------------------------------------------------------------
+    std::map<std::string, double> baseline;
+    if ( baseline_file != "" ) {
+        std::ifstream in( baseline_file );
+        if ( !in.is_open() ) die( "could not open baseline file " + baseline_file );
+        std::string name;
+        double      rate;
+        while( in >> name >> rate ) baseline[name] = rate;
+    }
+
+    printf( "%-18s %12s %12s %14s %-12s %s\n", "kernel", "items", "best_ms", "items/s", "unit", (baseline_file != "") ? "vs. baseline" : "" );
+    uint32_t slower_cnt = 0;
+    for( const auto& r : results )
+    {
+        printf( "%-18s %12llu %12.3f %14.6g %-12s", r.name.c_str(), static_cast<unsigned long long>( r.items ), r.best_s * 1000.0, r.rate, r.unit.c_str() );
+        auto it = baseline.find( r.name );
+        if ( it != baseline.end() ) {
+            double change_pct = (r.rate - it->second) / it->second * 100.0;
+            bool   slower     = change_pct < -tolerance_pct;
+            if ( slower ) slower_cnt++;
+            printf( " %+7.1f%%%s", change_pct, slower ? "  SLOWER" : "" );
+        } else if ( baseline_file != "" ) {
+            printf( "  (not in baseline)" );
+        }
+        printf( "\n" );
+    }
+    printf( "checksum %llx\n", static_cast<unsigned long long>( checksum ) );
+
+    if ( save_file != "" ) {
+        std::ofstream out( save_file );
+        out << std::setprecision( 6 );
+        for( const auto& r : results ) out << r.name << " " << r.rate << "\n";
+        if ( !out ) die( "could not write " + save_file );
+        printf( "saved baseline to %s\n", save_file.c_str() );
+    }
+    if ( slower_cnt != 0 ) {
+        printf( "%d kernel(s) more than %0.1f%% slower than %s\n", slower_cnt, tolerance_pct, baseline_file.c_str() );
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2014-2019 Robert A. Alfieri
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ber.h - Gaussian tail math for the statistical eye and BER bathtub curves (qam -stat and analyze -stat)
+//
+// A bathtub curve is the bit error rate at each sampling time or threshold offset.
+// Rather than counting errors, which would take about 1/BER symbols to see any,
+// the BER is extrapolated from Gaussian tails: q_func() is the probability of a 
+// standard normal sample above x, and q_inv() is its inverse, so a tail that is 
+// Gaussian is a straight line when plotted as q_inv( P ) against voltage.
+//
+#ifndef _BER_H
+#define _BER_H
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+static constexpr double BER_TARGETS[]   = { 1e-3, 1e-6, 1e-9, 1e-12 };   // eye openings are reported at these
+static constexpr double BER_LOG_FLOOR   = 1e-300;                        // BERs are clamped to this before log10()
+
+// P( standard normal > x )
+inline double q_func( double x )
+{
+    return 0.5 * std::erfc( x / std::sqrt( 2.0 ) );
+}
+
+// x such that q_func( x ) == p, for 0 < p < 1 (bisection; q_func() is decreasing)
+inline double q_inv( double p )
+{
+    double lo = -40.0;
+    double hi =  40.0;
+    for( uint32_t i = 0; i < 64; i++ )
+    {
+        double mid = (lo + hi) / 2.0;
+        if ( q_func( mid ) > p ) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo + hi) / 2.0;
+}
+
+//------------------------------------------------------
+// Opening of a bathtub curve at BER target: the width of the run of points around
+// the lowest BER whose BER is below target, with each end interpolated in log10( BER ) 
+// between the last point below target and the first one at or above it.  An end 
+// that runs off the curve stops at the last point.  0 if no point is below target.
+//------------------------------------------------------
+inline double bathtub_opening( const std::vector<double>& x, const std::vector<double>& ber, double target )
+{
+    if ( ber.empty() ) return 0.0;
+    size_t best = std::min_element( ber.begin(), ber.end() ) - ber.begin();
+    if ( ber[best] >= target ) return 0.0;
+    auto log_ber = [&]( size_t i ) { return std::log10( std::max( ber[i], BER_LOG_FLOOR ) ); };
+    auto cross   = [&]( size_t in, size_t out ) 
+    {
+        double a = (std::log10( target ) - log_ber( in )) / (log_ber( out ) - log_ber( in ));
+        return x[in] + a * (x[out] - x[in]);
+    };
+    size_t lo = best;
+    while( lo > 0 && ber[lo-1] < target ) lo--;
+    size_t hi = best;
+    while( (hi+1) < ber.size() && ber[hi+1] < target ) hi++;
+    double x_lo = (lo == 0)              ? x[lo] : cross( lo, lo-1 );
+    double x_hi = ((hi+1) == ber.size()) ? x[hi] : cross( hi, hi+1 );
+    return x_hi - x_lo;
+}
+
+#endif
@@ -0,0 +1,225 @@
+// Copyright (c) 2014-2019 Robert A. Alfieri
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// channel.h - in-process model of the channel between the qam TX source and the RX sampler
+//
+// The RX waveform is the TX source waveform convolved with the channel's impulse 
+// response, using FFT overlap-add.  The impulse response comes from either:
+//
+//   - LineModel: the lossy transmission line and terminations that out2sp puts in the SPICE deck, 
+//     evaluated in the frequency domain with ABCD matrices, or
+//
+//   - a one-time SPICE characterization: the RX response of the same deck to a 
+//     source step that starts at time 0.
+//
+#ifndef _CHANNEL_H
+#define _CHANNEL_H
+
+#include <cstdint>
+#include <cmath>
+#include <complex>
+#include <vector>
+#include <algorithm>
+
+typedef std::complex<double> cdouble;
+
+static constexpr uint32_t CHANNEL_TAP_CNT     = 4096;   // LineModel impulse response length in samples
+static constexpr uint32_t CHANNEL_TAP_CNT_MAX = 4096;   // longest step characterization used
+static constexpr uint32_t CHANNEL_H_FFT_CNT   = 32768;  // frequency points used to get the LineModel impulse response
+static constexpr double   CHANNEL_TAPER_FRAC  = 0.5;    // LineModel H is tapered to 0 from this fraction of Nyquist up
+
+//------------------------------------------------------
+// In-place radix-2 FFT; a.size() must be a power of 2.
+// The inverse includes the 1/n.
+//------------------------------------------------------
+inline void fft( std::vector<cdouble>& a, bool inverse )
+{
+    size_t n = a.size();
+    for( size_t i = 1, j = 0; i < n; i++ )
+    {
+        size_t bit = n >> 1;
+        for( ; (j & bit) != 0; bit >>= 1 ) j ^= bit;
+        j ^= bit;
+        if ( i < j ) std::swap( a[i], a[j] );
+    }
+    for( size_t len = 2; len <= n; len <<= 1 )
+    {
+        double ang = (inverse ? 2.0 : -2.0) * M_PI / double(len);
+        for( size_t k = 0; k < len/2; k++ )
+        {
+            cdouble w = std::polar( 1.0, ang * double(k) );
+            for( size_t i = k; i < n; i += len )
+            {
+                cdouble u = a[i];
+                cdouble v = a[i+len/2] * w;
+                a[i]       = u + v;
+                a[i+len/2] = u - v;
+            }
+        }
+    }
+    if ( inverse ) {
+        for( auto& x : a ) x /= double(n);
+    }
+}
+
+//------------------------------------------------------
+// Defaults are out2sp's 10mm organic package stripline (ngspice ltra model) with 
+// Z0 drive and termination resistors and 0.5pF at each end.
+//------------------------------------------------------
+struct LineModel
+{
+    double len_m = 0.010;                       // line length in meters
+    double r     = 5.361470e+01;                // per meter
+    double l     = 2.625091e-07;
+    double g     = 0.0;
+    double c     = 1.391871e-10;
+    double r_tx  = 44;                          // Tx drive resistance
+    double c_tx  = 0.5e-12;                     // Tx terminating capacitance
+    double r_rx  = 44;                          // Rx terminating resistance
+    double c_rx  = 0.5e-12;                     // Rx terminating capacitance
+
+    cdouble h( double f_hz ) const;             // V(rx) / V(source) at f_hz
+};
+
+inline cdouble LineModel::h( double f_hz ) const
+{
+    if ( f_hz < 1.0 ) f_hz = 1.0;               // the line's Zc is infinite at DC when g == 0
+    cdouble jw( 0.0, 2.0 * M_PI * f_hz );
+    cdouble z  = r + jw*l;
+    cdouble y  = g + jw*c;
+    cdouble gl = std::sqrt( z*y ) * len_m;
+    cdouble zc = std::sqrt( z/y );
+    cdouble A  = std::cosh( gl );
+    cdouble B  = zc * std::sinh( gl );
+    cdouble C  = std::sinh( gl ) / zc;
+    cdouble D  = A;
+
+    // [1 r_tx; 0 1] * [1 0; jw*c_tx 1] * [A B; C D], then terminated by r_rx || c_rx
+    cdouble P11 = 1.0 + r_tx*jw*c_tx;
+    cdouble M11 = P11*A + r_tx*C;
+    cdouble M12 = P11*B + r_tx*D;
+    cdouble y_rx = 1.0/r_rx + jw*c_rx;
+    return 1.0 / (M11 + M12*y_rx);
+}
+
+//------------------------------------------------------
+// Streaming FIR channel.  push() takes source samples every dt_ps and 
+// appends the RX samples that are complete; finish() appends the rest so 
+// that there is one RX sample per source sample.
+//------------------------------------------------------
+class Channel
+{
+public:
+    Channel( double dt_ps, const LineModel& model );
+    Channel( const std::vector<double>& step_response );   // RX response to a unit source step, every dt_ps from time 0
+
+    void push( const double * x, size_t cnt, std::vector<double>& y );
+    void finish( std::vector<double>& y );
+
+    const std::vector<double>& taps( void ) const { return h; }
+
+private:
+    std::vector<double>  h;                     // impulse response
+    size_t               fft_cnt;               // overlap-add FFT size
+    size_t               block_cnt;             // source samples per block
+    std::vector<cdouble> H;                     // FFT of h zero-padded to fft_cnt
+    std::vector<double>  in;                    // source samples of the current block
+    std::vector<double>  overlap;               // tail of the previous blocks' outputs
+    std::vector<cdouble> work;
+
+    void init( void );
+    void block( std::vector<double>& y );
+};
+
+inline Channel::Channel( double dt_ps, const LineModel& model )
+{
+    //------------------------------------------------------
+    // Sample H on a fine frequency grid, go back to the time domain, and keep 
+    // the start of the response.  The nearly lossless line between capacitive 
+    // ends rings for a long time near the sample rate's Nyquist frequency, which 
+    // the sampled waveform cannot represent anyway, so H is rolled off there 
+    // with a raised cosine.
+    //------------------------------------------------------
+    std::vector<cdouble> a( CHANNEL_H_FFT_CNT );
+    double df_hz = 1.0e12 / (dt_ps * double(CHANNEL_H_FFT_CNT));
+    for( uint32_t k = 0; k <= CHANNEL_H_FFT_CNT/2; k++ )
+    {
+        double frac  = double(k) / double(CHANNEL_H_FFT_CNT/2);
+        double taper = (frac <= CHANNEL_TAPER_FRAC) ? 1.0 : 0.5 + 0.5*std::cos( M_PI * (frac - CHANNEL_TAPER_FRAC) / (1.0 - CHANNEL_TAPER_FRAC) );
+        a[k] = model.h( double(k) * df_hz ) * taper;
+        if ( k != 0 && k != CHANNEL_H_FFT_CNT/2 ) a[CHANNEL_H_FFT_CNT-k] = std::conj( a[k] );
+    }
+    fft( a, true );
+    h.resize( CHANNEL_TAP_CNT );
+    for( uint32_t i = 0; i < CHANNEL_TAP_CNT; i++ ) h[i] = a[i].real();
+    init();
+}
+
+inline Channel::Channel( const std::vector<double>& step_response )
+{
+    size_t cnt = std::min<size_t>( step_response.size(), CHANNEL_TAP_CNT_MAX );
+    h.resize( std::max<size_t>( cnt, 1 ) );
+    for( size_t i = 0; i < cnt; i++ ) h[i] = step_response[i] - ((i == 0) ? 0.0 : step_response[i-1]);
+    init();
+}
+
+inline void Channel::init( void )
+{
+    fft_cnt = 1;
+    while( fft_cnt < 4*h.size() ) fft_cnt <<= 1;
+    block_cnt = fft_cnt - h.size() + 1;
+    H.assign( fft_cnt, 0.0 );
+    for( size_t i = 0; i < h.size(); i++ ) H[i] = h[i];
+    fft( H, false );
+    work.resize( fft_cnt );
+    overlap.assign( h.size()-1, 0.0 );
+    in.reserve( block_cnt );
+}
+
+inline void Channel::push( const double * x, size_t cnt, std::vector<double>& y )
+{
+    for( size_t i = 0; i < cnt; i++ )
+    {
+        in.push_back( x[i] );
+        if ( in.size() == block_cnt ) block( y );
+    }
+}
+
+inline void Channel::finish( std::vector<double>& y )
+{
+    if ( !in.empty() ) block( y );
+}
+
+inline void Channel::block( std::vector<double>& y )
+{
+    size_t cnt = in.size();
+    std::fill( work.begin(), work.end(), 0.0 );
+    for( size_t i = 0; i < cnt; i++ ) work[i] = in[i];
+    fft( work, false );
+    for( size_t i = 0; i < fft_cnt; i++ ) work[i] *= H[i];
+    fft( work, true );
+    size_t tail_cnt = overlap.size();
+    for( size_t i = 0; i < tail_cnt; i++ ) work[i] += overlap[i];
+    for( size_t i = 0; i < cnt; i++ ) y.push_back( work[i].real() );
+    for( size_t i = 0; i < tail_cnt; i++ ) overlap[i] = work[cnt+i].real();
+    in.clear();
+}
+
+#endif
@@ -0,0 +1,167 @@
+// Copyright (c) 2014-2019 Robert A. Alfieri
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// perf.h - per-phase wall time, item counts and throughput, plus peak RSS, written as JSON
+//
+// Usage:
+//
+//     Perf perf;                                   // disabled until perf.enabled = true
+//     {
+//         Perf::Scope scope( perf, "sweep" );      // times until the end of the block
+//         ...
+//         scope.count( "grid_points", n );         
+//     }                                            // or scope.stop()
+//     perf.write_json( "analyze", path );
+//
+// A phase that is entered more than once accumulates its time and counts.
+// When perf is disabled, a Scope costs one branch.  Scopes are for the main thread only.
+//
+// Peak RSS is the process's (getrusage() has no per-phase peak), so each phase 
+// reports it as process_peak_rss_kb_at_end: the peak so far when the phase last
+// ended, which only tells that phase's peak if it is higher than all before it.
+//
+#ifndef _PERF_H
+#define _PERF_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <sys/resource.h>
+
+class Perf
+{
+public:
+    bool enabled = false;
+
+    Perf( void ) : created( std::chrono::steady_clock::now() ) {}
+
+    class Scope
+    {
+    public:
+        Scope( Perf& perf_, const char * name ) : perf( perf_ ), phase_i( perf_.enabled ? perf_.phase_index( name ) : -1 )
+        {
+            if ( phase_i >= 0 ) start = std::chrono::steady_clock::now();
+        }
+
+        ~Scope() { stop(); }
+
+        // end the phase before the end of the block
+        void stop( void )
+        {
+            if ( phase_i >= 0 ) perf.stop( phase_i, std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() );
+            phase_i = -1;
+        }
+
+        void count( const char * unit, uint64_t n ) { if ( phase_i >= 0 ) perf.count( phase_i, unit, n ); }
+
+    private:
+        Perf&    perf;
+        int      phase_i;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // peak resident set size of the process so far, in KiB
+    static uint64_t peak_rss_kb( void )
+    {
+        struct rusage usage;
+        if ( getrusage( RUSAGE_SELF, &usage ) != 0 ) return 0;
+#ifdef __APPLE__
+        return uint64_t(usage.ru_maxrss) / 1024;    // bytes on macOS
+#else
+        return uint64_t(usage.ru_maxrss);           // KiB on Linux
+#endif
+    }
+
+    // Returns false if the file can't be written.  "-" means stdout.
+    bool write_json( std::string prog, std::string path ) const
+    {
+        std::string json = "{\n  \"program\": \"" + prog + "\",\n  \"phases\": [";
+        for( size_t i = 0; i < phases.size(); i++ )
+        {
+            const Phase& p = phases[i];
+            char buf[256];
+            snprintf( buf, sizeof( buf ), "%s\n    { \"name\": \"%s\", \"calls\": %llu, \"wall_s\": %.6f, \"process_peak_rss_kb_at_end\": %llu", 
+                      (i == 0) ? "" : ",", p.name.c_str(), static_cast<unsigned long long>( p.calls ), p.wall_s, 
+                      static_cast<unsigned long long>( p.process_peak_rss_kb_at_end ) );
+            json += buf;
+            for( const auto& c : p.counts )
+            {
+                snprintf( buf, sizeof( buf ), ", \"%s\": %llu, \"%s_per_s\": %.6g", c.unit.c_str(), static_cast<unsigned long long>( c.n ), 
+                          c.unit.c_str(), (p.wall_s > 0.0) ? double(c.n) / p.wall_s : 0.0 );
+                json += buf;
+            }
+            json += " }";
+        }
+        char buf[128];
+        snprintf( buf, sizeof( buf ), "\n  ],\n  \"total_wall_s\": %.6f,\n  \"peak_rss_kb\": %llu\n}\n", 
+                  std::chrono::duration<double>( std::chrono::steady_clock::now() - created ).count(), 
+                  static_cast<unsigned long long>( peak_rss_kb() ) );
+        json += buf;
+
+        if ( path == "-" ) return fputs( json.c_str(), stdout ) >= 0;
+        std::ofstream out( path );
+        out << json;
+        return bool( out );
+    }
+
+private:
+    struct Count
+    {
+        std::string unit;
+        uint64_t    n;
+    };
+
+    struct Phase
+    {
+        std::string        name;
+        uint64_t           calls;
+        double             wall_s;
+        uint64_t           process_peak_rss_kb_at_end;  // of the last call
+        std::vector<Count> counts;
+    };
+
+    std::vector<Phase> phases;                      // in the order first entered
+    std::chrono::steady_clock::time_point created;  // total_wall_s is from here (start-up, for a global Perf)
+
+    int phase_index( const char * name ) 
+    {
+        for( size_t i = 0; i < phases.size(); i++ ) if ( phases[i].name == name ) return int(i);
+        phases.push_back( Phase{ name, 0, 0.0, 0, {} } );
+        return int(phases.size()-1);
+    }
+
+    void stop( int i, double wall_s )
+    {
+        phases[i].calls++;
+        phases[i].wall_s     += wall_s;
+        phases[i].process_peak_rss_kb_at_end = peak_rss_kb();
+    }
+
+    void count( int i, const char * unit, uint64_t n )
+    {
+        for( auto& c : phases[i].counts ) if ( c.unit == unit ) { c.n += n; return; }
+        phases[i].counts.push_back( Count{ unit, n } );
+    }
+};
+
+#endif
@@ -18,59 +18,152 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 // THE SOFTWARE.
 //
-// qam.c - simulate N-QAM (N = 4 or 16 currently)
+// qam.c - simulate N-QAM (N = 4, 16, 64, or 256)
 //
 #include <cstdint>
 #include <string>
 #include <cmath>
 #include <iostream>
 #include <bitset>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
 #include "stdlib.h"
+#include "qam.h"
+#include "perf.h"
+#include "ber.h"
 
 static constexpr bool     debug              = false;
 
-// config constants
-static constexpr uint32_t N_SQRT             = 4;   // sqrt(N)
-static constexpr double   CLK_GHZ            = 10;  // 10 GHz (half the actual symbol transmit speed)
-static constexpr uint32_t CLK_TIMESTEP_CNT   = 50;  // there are 2 timesteps per CLK_GHZ
-static constexpr double   mV_MAX             = 200; // 200 mV max per clock
-static constexpr bool     USE_SIN_COS        = false;
-static constexpr double   TRANS_START_FRAC   = 0.40; // fraction of half-clock where transition starts
-static constexpr double   TRANS_END_FRAC     = 0.60; // fraction of half-clock where transition ends
-
-// derived constants
-static constexpr double   N_SQRT_F           = N_SQRT;
-static constexpr uint32_t N                  = N_SQRT * N_SQRT;
-static constexpr uint32_t INIT_PHASE_CNT_LG2 = 8;
-static constexpr uint32_t INIT_PHASE_CNT     = 1 << INIT_PHASE_CNT_LG2;
-static constexpr double   PI_DIV_2           = M_PI / 2.0;
-static constexpr double   EPSILON            = 1e-10;
-static constexpr double   CLK_PERIOD_PS      = 1000.0 / CLK_GHZ;
-static constexpr double   TIMESTEP_PS        = CLK_PERIOD_PS / double(CLK_TIMESTEP_CNT);
-static constexpr double   RISING_START_PS    = CLK_PERIOD_PS/2.0 * TRANS_START_FRAC;
-static constexpr double   RISING_END_PS      = CLK_PERIOD_PS/2.0 * TRANS_END_FRAC;
-static constexpr double   FALLING_START_PS   = CLK_PERIOD_PS/2.0 * (1.0-TRANS_END_FRAC);
-static constexpr double   FALLING_END_PS     = CLK_PERIOD_PS/2.0 * (1.0-TRANS_START_FRAC);
-static constexpr double   mV_MID             = mV_MAX / 3.0;
-static constexpr double   mV_INC             = mV_MID;
+static constexpr uint32_t SIM_BLOCK_CLK_CNT = 1 << 16;  // clocks simulated (and buffered) per round of threads
+static constexpr double   NEXT_COUPLING     = 0.05;     // -lanes: default near-end crosstalk per neighbor (fraction of its voltage)
+static constexpr double   FEXT_COUPLING     = 0.3;      // -lanes: default far-end crosstalk per neighbor (fraction of its per-timestep change)
+static constexpr double   STAT_NOISE_mV     = 8.0;      // -stat: default RMS of the Gaussian noise added at the RX
+static constexpr double   STAT_VT_STEP_mV   = 4.0;      // -stat: threshold offsets in the threshold bathtub
+static constexpr uint64_t PATTERN_CLK_CNT_MAX = 1 << 28; // -debruijn: most clocks (N^depth) allowed
 
 // global variables
-static double x[N];
-static double y[N];
+static double x[N_MAX];
+static double y[N_MAX];
+static uint64_t rng_key;                                // derived from the seed
+static bool     use_libc_rand = false;                  // -rng libc: old srand()/rand() stream, single-threaded
+static uint32_t thread_cnt    = 1;                      // -threads (0 means std::thread::hardware_concurrency())
+
+enum class OutMode { TEXT, BIN, SUMMARY, SP };
+static OutMode     out_mode = OutMode::TEXT;            // -out text|bin|summary|sp
+static std::string out_file = "";                       // -out_file for -out bin (default qam.bin) or sp (default qam.<line_len>.sp)
+static std::string line_len = "10m";                    // -line_len for -out sp (10mm, not 10 meters)
+static std::string spice    = "ngspice";                // -spice ngspice|hspice for -out sp
+static Perf        perf;                                // -perf <json_file>: per-phase timing
+static std::string perf_file = "";
+static uint32_t    lane_cnt  = 0;                       // -lanes: simulate a bus of this many lanes (0 means one lane, the usual outputs)
+static double      next_coupling = NEXT_COUPLING;       // -next
+static double      fext_coupling = FEXT_COUPLING;       // -fext
+static bool        stat_eye  = false;                   // -stat: statistical eye and BER bathtubs instead of simulating clocks
+static double      stat_noise_mV = STAT_NOISE_mV;       // -noise
+static uint32_t    pattern_depth = 0;                   // -debruijn: every pattern of this many symbols once instead of random symbols
+static std::vector<uint8_t> pattern;                    // -debruijn: the symbols
+
+// eye width accumulators; tot is in timesteps so that merging is exact in any order
+struct EyeStats
+{
+    double   eye_width_ps_min = 1000000.0;
+    double   eye_width_ps_max = 0.0;
+    uint64_t eye_ts_cnt_tot   = 0;
+};
 
 // forward decls
 void choose_points( void );
-void sim( uint32_t clk_cnt );
+template<uint32_t N_SQRT> void sim( uint32_t clk_cnt );
+template<uint32_t N_SQRT> void sim_bus( uint32_t clk_cnt );
+template<uint32_t N_SQRT> void sim_stat( void );
+template<uint32_t N_SQRT> uint32_t make_pattern( uint32_t depth );
 
 int main( int argc, const char * argv[] )
 {
     uint32_t seed    = 0xb0b1cafe;
     uint32_t clk_cnt = 256;
-    if ( argc >= 2 ) seed    = std::atoi( argv[1] );
-    if ( argc >= 3 ) clk_cnt = std::atoi( argv[2] );
+    uint32_t n_sqrt  = N_SQRT_DEFAULT;
+    uint32_t pos_i   = 0;
+    for( int i = 1; i < argc; i++ )
+    {
+        std::string arg = argv[i];
+        if ( arg == "-threads" && (i+1) < argc ) {
+            thread_cnt = std::atoi( argv[++i] );
+        } else if ( arg == "-qam" && (i+1) < argc ) {
+            n_sqrt = uint32_t( std::sqrt( std::atof( argv[++i] ) ) + 0.5 );
+            if ( !qam_order_ok( n_sqrt ) || std::to_string( n_sqrt*n_sqrt ) != argv[i] ) { std::cout << "ERROR: -qam must be 4, 16, 64, or 256\n"; exit( 1 ); }
+        } else if ( arg == "-rng" && (i+1) < argc ) {
+            std::string rng = argv[++i];
+            if ( rng != "splitmix" && rng != "libc" ) { std::cout << "ERROR: -rng must be splitmix or libc\n"; exit( 1 ); }
+            use_libc_rand = rng == "libc";
+        } else if ( arg == "-out" && (i+1) < argc ) {
+            std::string mode = argv[++i];
+            if ( mode != "text" && mode != "bin" && mode != "summary" && mode != "sp" ) { std::cout << "ERROR: -out must be text, bin, summary, or sp\n"; exit( 1 ); }
+            out_mode = (mode == "text") ? OutMode::TEXT : (mode == "bin") ? OutMode::BIN : (mode == "summary") ? OutMode::SUMMARY : OutMode::SP;
+        } else if ( arg == "-out_file" && (i+1) < argc ) {
+            out_file = argv[++i];
+        } else if ( arg == "-line_len" && (i+1) < argc ) {
+            line_len = argv[++i];
+            if ( line_len.empty() || line_len.back() != 'm' ) line_len += "m";
+        } else if ( arg == "-spice" && (i+1) < argc ) {
+            spice = argv[++i];
+            if ( spice != "ngspice" && spice != "hspice" ) { std::cout << "ERROR: -spice must be ngspice or hspice\n"; exit( 1 ); }
+        } else if ( arg == "-perf" && (i+1) < argc ) {
+            perf_file    = argv[++i];
+            perf.enabled = true;
+        } else if ( arg == "-lanes" && (i+1) < argc ) {
+            lane_cnt = std::atoi( argv[++i] );
+            if ( lane_cnt == 0 ) { std::cout << "ERROR: -lanes must be positive\n"; exit( 1 ); }
+        } else if ( arg == "-next" && (i+1) < argc ) {
+            next_coupling = std::atof( argv[++i] );
+        } else if ( arg == "-fext" && (i+1) < argc ) {
+            fext_coupling = std::atof( argv[++i] );
+        } else if ( arg == "-stat" ) {
+            stat_eye = true;
+        } else if ( arg == "-noise" && (i+1) < argc ) {
+            stat_noise_mV = std::atof( argv[++i] );
+            if ( stat_noise_mV <= 0.0 ) { std::cout << "ERROR: -noise must be positive\n"; exit( 1 ); }
+        } else if ( arg == "-debruijn" && (i+1) < argc ) {
+            pattern_depth = std::atoi( argv[++i] );
+            if ( pattern_depth < 2 ) { std::cout << "ERROR: -debruijn depth must be at least 2\n"; exit( 1 ); }
+        } else if ( arg[0] != '-' && pos_i == 0 ) {
+            seed = std::atoi( argv[i] );
+            pos_i++;
+        } else if ( arg[0] != '-' && pos_i == 1 ) {
+            clk_cnt = std::atoi( argv[i] );
+            pos_i++;
+        } else {
+            std::cout << "ERROR: usage: qam [seed [clk_cnt]] [-qam 4|16|64|256] [-threads <cnt>] [-rng splitmix|libc] [-out text|bin|summary|sp] [-out_file <file>] [-line_len <len>] [-spice ngspice|hspice] [-perf <json_file>|-] [-lanes <cnt> [-next <coupling>] [-fext <coupling>]] [-stat [-noise <mV>]] [-debruijn <depth>]\n";
+            exit( 1 );
+        }
+    }
+    if ( thread_cnt == 0 ) thread_cnt = std::thread::hardware_concurrency();
+    if ( thread_cnt == 0 || use_libc_rand ) thread_cnt = 1;
+    if ( lane_cnt != 0 && use_libc_rand ) { std::cout << "ERROR: -lanes needs -rng splitmix\n"; exit( 1 ); }
+    if ( lane_cnt != 0 && stat_eye ) { std::cout << "ERROR: -stat does not model -lanes\n"; exit( 1 ); }
+    if ( pattern_depth != 0 && (lane_cnt != 0 || stat_eye) ) { std::cout << "ERROR: -debruijn does not apply to -lanes or -stat\n"; exit( 1 ); }
+    if ( out_file == "" ) out_file = (out_mode == OutMode::SP) ? ("qam." + line_len + ".sp") : "qam.bin";
 
     srand( seed );
-    sim( clk_cnt );
+    rng_key = seed;
+    if ( pattern_depth != 0 ) {
+        uint64_t pattern_clk_cnt = 1;
+        for( uint32_t k = 0; k < pattern_depth && pattern_clk_cnt <= PATTERN_CLK_CNT_MAX; k++ ) pattern_clk_cnt *= n_sqrt*n_sqrt;
+        if ( pattern_clk_cnt > PATTERN_CLK_CNT_MAX ) { std::cout << "ERROR: -debruijn depth is too large for this QAM order\n"; exit( 1 ); }
+        clk_cnt = qam_dispatch( n_sqrt, [&]( auto n ) { return make_pattern<decltype( n )::value>( pattern_depth ); } );
+    }
+    if ( stat_eye ) {
+        qam_dispatch( n_sqrt, [&]( auto n ) { sim_stat<decltype( n )::value>(); } );
+    } else if ( lane_cnt != 0 ) {
+        qam_dispatch( n_sqrt, [&]( auto n ) { sim_bus<decltype( n )::value>( clk_cnt ); } );
+    } else {
+        qam_dispatch( n_sqrt, [&]( auto n ) { sim<decltype( n )::value>( clk_cnt ); } );
+    }
+    if ( perf.enabled && !perf.write_json( "qam", perf_file ) ) { std::cout << "ERROR: could not write " << perf_file << "\n"; exit( 1 ); }
     return 0;
 }
 
@@ -79,107 +172,593 @@ uint32_t rand_n( uint32_t n )
     return rand() % n;
 }
 
-void sim( uint32_t clk_cnt )
+//------------------------------------------------------
+// Counter-based RNG.
+// Random number i is SplitMix64's output for counter i, so it depends only on
+// (seed, i) and any clock's symbol can be generated without the ones before it.
+// rand_n_at() maps it to 0 .. n-1 without modulo bias (Lemire's multiply-shift
+// with rejection, redrawing from the same counter).
+//------------------------------------------------------
+inline uint64_t splitmix64( uint64_t z )
 {
-    //------------------------------------------------------
-    // For each clock cycle
-    //------------------------------------------------------
-    std::cout << "TIMESTEP_PS=" << TIMESTEP_PS << "\n";
-    std::cout << "RISING_START_PS=" << RISING_START_PS << "\n";
-    std::cout << "RISING_END_PS=" << RISING_END_PS << "\n";
-    std::cout << "FALLING_START_PS=" << FALLING_START_PS << "\n";
-    std::cout << "FALLING_END_PS=" << FALLING_END_PS << "\n";
-    std::cout << "\n";
-    double Q_mag_prev = mV_MAX;
-    double eye_width_ps_min = 1000000.0;
-    double eye_width_ps_max = 0.0;
-    double eye_width_ps_tot = 0.0;
-    for( uint32_t i = 0; i < clk_cnt; i++ )
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+uint32_t rand_n_at( uint64_t i, uint32_t n )
+{
+    uint64_t z = splitmix64( rng_key ) + (i+1) * 0x9e3779b97f4a7c15ULL;
+    uint32_t threshold = uint32_t(-n) % n;
+    for( ;; )
+    {
+        uint64_t r = splitmix64( z );
+        uint64_t m = uint64_t(uint32_t(r >> 32)) * n;
+        if ( uint32_t(m) >= threshold ) return uint32_t(m >> 32);
+        z += 0x9e3779b97f4a7c15ULL;
+    }
+}
+
+// symbol bits for clock i
+template<uint32_t N_SQRT>
+inline uint32_t clk_bits( uint64_t i )
+{
+    return !pattern.empty() ? pattern[i] : use_libc_rand ? rand_n( N_SQRT*N_SQRT ) : rand_n_at( i, N_SQRT*N_SQRT );
+}
+
+//------------------------------------------------------
+// -debruijn: instead of random symbols, a de Bruijn sequence of the N symbols 
+// for the given depth, in which each of the N^depth patterns of depth symbols 
+// appears exactly once (cyclically).  A clock's waveform depends on its symbol
+// and the previous symbol's Q_mag, so with depth >= 2 every waveform is seen 
+// and each one as often as its probability with random symbols: min is the 
+// guaranteed worst eye width and avg is the exact average, in N^depth clocks.
+// Deeper patterns are for the channel's longer memory in the SPICE and 
+// analyze flows (-out sp or bin).
+//
+// The sequence is the concatenation of the Lyndon words whose lengths divide
+// depth, in lexicographic order (generated with Duval's algorithm).  It is 
+// rotated to end with a symbol whose Q level is the top one, which is the 
+// Q_mag_prev that clock 0 starts with, so the wrap-around pattern is covered too.
+//------------------------------------------------------
+template<uint32_t N_SQRT>
+uint32_t make_pattern( uint32_t depth )
+{
+    constexpr uint32_t N = N_SQRT*N_SQRT;
+    std::vector<uint8_t>  seq;
+    std::vector<uint32_t> w( depth, 0 );                // the current Lyndon word is w[0 .. len-1]
+    uint32_t len = 1;
+    while( len != 0 )
+    {
+        if ( (depth % len) == 0 ) {
+            for( uint32_t j = 0; j < len; j++ ) seq.push_back( uint8_t(w[j]) );
+        }
+        for( uint32_t j = len; j < depth; j++ ) w[j] = w[j-len];
+        len = depth;
+        while( len != 0 && w[len-1] == N-1 ) len--;
+        if ( len != 0 ) w[len-1]++;
+    }
+    size_t last = 0;
+    for( size_t j = 0; j < seq.size(); j++ ) 
+    {
+        if ( Q_level_of<N_SQRT>( seq[j] ) == N_SQRT-1 ) last = j;
+    }
+    pattern.assign( seq.begin() + last + 1, seq.end() );
+    pattern.insert( pattern.end(), seq.begin(), seq.begin() + last + 1 );
+    return uint32_t(pattern.size());
+}
+
+//------------------------------------------------------
+// Simulate clocks first .. last-1, writing them to out and accumulating into stats.
+// Clock first's Q_mag_prev comes from clock first-1, regenerated from its counter.
+// (-rng libc can't regenerate a clock, but it is single-threaded, so its one 
+// range starts at clock 0.)  Nothing here writes globals, since the threads 
+// of sim() run this at the same time.
+//------------------------------------------------------
+template<uint32_t N_SQRT>
+void sim_range( uint32_t first, uint32_t last, std::ostream& out, EyeStats& stats )
+{
+    uint32_t Q_level_prev = (first == 0) ? N_SQRT-1 :   // mV_MAX
+                                           Q_level_of<N_SQRT>( clk_bits<N_SQRT>( first-1 ) );
+    const WaveTable<N_SQRT>& wave_table = waves<N_SQRT>();
+    for( uint32_t i = first; i < last; i++ )
     {
         //------------------------------------------------------
         // Choose random bits from 0 .. N-1.
         // Then determine peak amplitude and polarity of I and Q clocks.
         //------------------------------------------------------
-        uint32_t bits = rand_n( N );
-        bool     I_pos = (bits & 1) != 0;
-        bool     Q_pos = (bits & 2) != 0;
-        double   I_mag;
-        double   Q_mag;
-        if ( N == 16 && (bits & 4) == 0 ) {
-            I_mag = I_pos ? mV_MID : -mV_MID;
-        } else {
-            I_mag = I_pos ? mV_MAX : -mV_MAX;
+        uint32_t bits    = clk_bits<N_SQRT>( i );
+        uint32_t I_level = I_level_of<N_SQRT>( bits );
+        uint32_t Q_level = Q_level_of<N_SQRT>( bits );
+
+        //------------------------------------------------------
+        // Look up I and Q voltage at each timestep.
+        // See make_clk_wave() for how they are derived.
+        //------------------------------------------------------
+        const ClkWave& w = wave_table.wave[Q_level_prev][I_level][Q_level];
+        double eye_width_ps = w.eye_width_ps;
+        if ( out_mode == OutMode::TEXT ) {
+            out << i << ": " << std::bitset<qam_bit_cnt( N_SQRT )>( bits ) << " I_mag=" << level_mV( N_SQRT, I_level ) << " Q_mag=" << level_mV( N_SQRT, Q_level ) << ":\n";
+            for( uint32_t ts = 1; ts <= CLK_TIMESTEP_CNT; ts++ )
+            {
+                std::string clk_str = (ts == (CLK_TIMESTEP_CNT/2)) ? "  <---- I_clk samples here" :
+                                      (ts == CLK_TIMESTEP_CNT)     ? "  <---- Q_clk samples here" : "";
+                out << (w.in_eye[ts-1] ? "*" : " ") << "   " << w.I_mV[ts-1] << " + " << w.Q_mV[ts-1] << " = " << w.IQ_mV[ts-1] << clk_str << "\n";
+            }
+            out << "    eye_width=" << eye_width_ps << " ps\n";
+        } else if ( out_mode == OutMode::BIN || out_mode == OutMode::SP ) {
+            out.put( char(bits) );
         }
-        if ( N == 16 && (bits & 8) == 0 ) {
-            Q_mag = Q_pos ? mV_MID : -mV_MID;
-        } else {
-            Q_mag = Q_pos ? mV_MAX : -mV_MAX;
+        if ( eye_width_ps < stats.eye_width_ps_min ) stats.eye_width_ps_min = eye_width_ps;
+        if ( eye_width_ps > stats.eye_width_ps_max ) stats.eye_width_ps_max = eye_width_ps;
+        stats.eye_ts_cnt_tot += w.eye_ts_cnt;
+        Q_level_prev = Q_level;
+    }
+}
+
+//------------------------------------------------------
+// -out sp writes the ngspice/hspice deck that out2sp used to build from the 
+// text output, including the 10mm stripline channel.
+//
+// The VI/VQ/VIQ sources are the same piecewise-linear functions as before 
+// (one point per timestep), but only the points where the slope changes are 
+// written. For the sharp-edge waveform, that is a handful per half clock 
+// instead of CLK_TIMESTEP_CNT per clock.
+//------------------------------------------------------
+static constexpr double PWL_SLOPE_EPSILON_mV = 1e-7;    // smaller per-timestep slope changes are rounding
+
+template<uint32_t N_SQRT>
+void write_pwl( std::ostream& out, const char * header, const std::string& syms, int which )
+{
+    // which: 0=I, 1=Q, 2=IQ
+    char buf[64];
+    out << header << " PWL ( 0p, 0m";
+    auto point = [&]( uint64_t ts, double mV ) 
+    {
+        snprintf( buf, sizeof( buf ), "\n+ , %.15gp, %6.4fm", double(ts) * TIMESTEP_PS, 2.0 * mV );
+        out << buf;
+    };
+    const WaveTable<N_SQRT>& wave_table = waves<N_SQRT>();
+    uint32_t Q_level_prev = N_SQRT-1;
+    uint64_t ts      = 0;
+    double   mV_prev = 0.0;
+    double   dV_prev = 0.0;
+    for( uint64_t i = 0; i < syms.size(); i++ )
+    {
+        uint32_t bits    = uint8_t(syms[i]);
+        uint32_t Q_level = Q_level_of<N_SQRT>( bits );
+        const ClkWave& w = wave_table.wave[Q_level_prev][I_level_of<N_SQRT>( bits )][Q_level];
+        const real * mV = (which == 0) ? w.I_mV : (which == 1) ? w.Q_mV : w.IQ_mV;
+        for( uint32_t t = 0; t < CLK_TIMESTEP_CNT; t++, ts++ )
+        {
+            double dV = double(mV[t]) - mV_prev;
+            if ( ts != 0 && std::fabs( dV - dV_prev ) > PWL_SLOPE_EPSILON_mV ) point( ts, mV_prev );
+            mV_prev = double(mV[t]);
+            dV_prev = dV;
         }
-        double   I_min = (I_mag == -mV_MAX) ? -1000000.0 : (I_mag-mV_INC);
-        double   I_max = (I_mag ==  mV_MAX) ?  1000000.0 : (I_mag+mV_INC);
+        Q_level_prev = Q_level;
+    }
+    if ( ts != 0 ) point( ts, mV_prev );
+    out << " )\n";
+}
+
+template<uint32_t N_SQRT>
+void write_sp_deck( const std::string& syms )
+{
+    std::string sp_base = out_file;
+    if ( sp_base.size() > 3 && sp_base.compare( sp_base.size()-3, 3, ".sp" ) == 0 ) sp_base.resize( sp_base.size()-3 );
+    bool use_ngspice = spice == "ngspice";
+    uint64_t end_time = uint64_t( double(syms.size() * CLK_TIMESTEP_CNT) * TIMESTEP_PS + 0.5 );
+
+    std::ofstream out( out_file );
+    if ( !out.is_open() ) { std::cout << "ERROR: unable to open " << out_file << " for output\n"; exit( 1 ); }
+    out << "* " << sp_base << ".sp\n";
+    out << ".param Vmax = " << mV_MAX << "m\n";
+    out << ".param GND  = 0m\n";
+    out << ".param Vmin = -" << mV_MAX << "m\n";
+    out << ".param Z0   = 44\n";
+    out << "\n";
+    write_pwl<N_SQRT>( out, "VI   I_clk 0 DC 0.0", syms, 0 );
+    write_pwl<N_SQRT>( out, "VQ   Q_clk 0 DC 0.0", syms, 1 );
+    write_pwl<N_SQRT>( out, "VIQ IQ_clk 0 DC 0.0", syms, 2 );
+    out << "\n";
+    out << "* LC-dominated lossy transmission line (" << line_len << ") with Z0 \n";
+    out << "Rw0rt IQ_clk    IQ_clk_tx      R='Z0'   $ Tx drive resistance\n";
+    out << "Cw0t  IQ_clk_tx GND  0.5p               $ Tx terminating capacitance\n";
+    if ( use_ngspice ) {
+        out << ".model line ltra len='" << line_len << "' rel=1  $ transmission line proper (one wire)\n";
+        out << "+ l   = 2.625091e-07 \n";
+        out << "+ c   = 1.391871e-10 \n";
+        out << "+ r   = 5.361470e+01 \n";
+        out << "+ g   = 0.0000000+00\n";
+        out << "ow0   IQ_clk_tx GND  IQ_clk_rx GND line \n";
+    } else {
+        out << ".model hdi_model W MODELTYPE=RLGC, N=1  $ transmission line proper (one wire)\n";
+        out << "+ Lo = 2.625091e-07\n";
+        out << "+ Co = 1.391871e-10\n";
+        out << "+ Ro = 5.361470e+01\n";
+        out << "+ Go = 0.000000e+00\n";
+        out << "+ Rs = 5.292260e-03\n";
+        out << "W1    IQ_clk_tx GND  IQ_clk_rx GND  RLGCmodel=hdi_model N=1 L=5mm\n";
+    }
+    out << "Cw0r  IQ_clk_rx GND  0.5p               $ Rx terminating capacitance\n";
+    out << "Rw0r  IQ_clk_rx GND            R='Z0'   $ Rx terminating resistance \n";
+    out << "\n";
+    out << ".OP\n";
+    out << ".tran 1p " << end_time << "p\n";
+    out << ".save v(I_clk) v(Q_clk) v(IQ_clk) v(IQ_clk_rx)\n";
+    if ( use_ngspice ) {
+        out << ".control\n";
+        out << "run\n";
+        out << "hardcopy " << sp_base << ".iqiq.eps v(I_clk) v(Q_clk) v(IQ_clk)\n";
+        out << "hardcopy " << sp_base << ".inq.eps v(I_clk) v(Q_clk)\n";
+        out << "hardcopy " << sp_base << ".i.eps v(I_clk) \n";
+        out << "hardcopy " << sp_base << ".q.eps v(Q_clk) \n";
+        out << "hardcopy " << sp_base << ".iqt.eps v(IQ_clk_tx) \n";
+        out << "hardcopy " << sp_base << ".iqr.eps v(IQ_clk_rx)\n";
+        out << "hardcopy " << sp_base << ".iqiq.eps v(IQ_clk) v(IQ_clk_rx)\n";
+        out << ".endc\n";
+    } else {
+        out << ".option post=2 probe runlvl=5 accurate \n";
+    }
+    out.close();
+    if ( !out ) { std::cout << "ERROR: could not write " << out_file << "\n"; exit( 1 ); }
+}
+
+template<uint32_t N_SQRT>
+void sim( uint32_t clk_cnt )
+{
+    {
+        Perf::Scope scope( perf, "tables" );
+        waves<N_SQRT>();
+        scope.count( "clock_waves", N_SQRT*N_SQRT*N_SQRT );
+    }
 
+    //------------------------------------------------------
+    // For each clock cycle
+    //------------------------------------------------------
+    std::ofstream bin_out;
+    if ( out_mode == OutMode::BIN ) {
+        bin_out.open( out_file, std::ios::binary );
+        if ( !bin_out.is_open() ) { std::cout << "ERROR: could not open " << out_file << " for output\n"; exit( 1 ); }
+        write_bin_header<N_SQRT>( bin_out, clk_cnt );
+    }
+    std::ostringstream sp_syms;
+    std::ostream& out = (out_mode == OutMode::BIN) ? static_cast<std::ostream&>( bin_out ) : 
+                        (out_mode == OutMode::SP)  ? static_cast<std::ostream&>( sp_syms ) : std::cout;
+    if ( out_mode == OutMode::TEXT ) {
+        std::cout << "TIMESTEP_PS=" << TIMESTEP_PS << "\n";
+        std::cout << "RISING_START_PS=" << RISING_START_PS << "\n";
+        std::cout << "RISING_END_PS=" << RISING_END_PS << "\n";
+        std::cout << "FALLING_START_PS=" << FALLING_START_PS << "\n";
+        std::cout << "FALLING_END_PS=" << FALLING_END_PS << "\n";
+        std::cout << "\n";
+    }
+    EyeStats stats;
+    if ( thread_cnt == 1 ) {
+        Perf::Scope scope( perf, "generate" );     // includes output, which is interleaved
+        sim_range<N_SQRT>( 0, clk_cnt, out, stats );
+        scope.count( "clocks", clk_cnt );
+    } else {
         //------------------------------------------------------
-        // Figure out I and Q voltage at each timestep.
-        // Let I be a sin() wave and Q be a cos() wave.
-        // We define a clock period as PI.
-        // Then sum them.  
+        // Each round, split a block of clocks across the threads.
+        // Each thread formats into its own buffer and the buffers 
+        // are written out in clock order, so the output is the same 
+        // as with one thread.
         //------------------------------------------------------
-        std::cout << i << ": " << std::bitset<N_SQRT>( bits ) << " I_mag=" << I_mag << " Q_mag=" << Q_mag << ":\n";
-        uint32_t I_ts_eye_cnt = 0;
-        uint32_t I_ts_eye_cnt_max = 0;
-        for( uint32_t ts = 1; ts <= CLK_TIMESTEP_CNT; ts++ )
+        std::vector<std::ostringstream> outs( thread_cnt );
+        std::vector<EyeStats>           thread_stats( thread_cnt );
+        for( uint32_t block = 0; block < clk_cnt; block += SIM_BLOCK_CLK_CNT )
         {
-            double a = double( ts ) * M_PI / double(CLK_TIMESTEP_CNT);
-            double I_mV, Q_mV;
-            if ( USE_SIN_COS ) {
-                I_mV = I_mag * sin( a );
-                double Q_mgg = (ts <= CLK_TIMESTEP_CNT/2) ? Q_mag_prev : -Q_mag;
-                Q_mV = Q_mgg * cos( a );
-            } else {
-                //------------------------------------------------------
-                // Sharp Edges
-                //------------------------------------------------------
-                bool     I_rising     = ts <= CLK_TIMESTEP_CNT/2;
-                uint32_t ts_eff       = I_rising ? ts         : (ts - CLK_TIMESTEP_CNT/2);
-                double   ps           = double(ts_eff) * TIMESTEP_PS;
-                double   rising_to    = I_rising ? I_mag      : Q_mag;  
-                double   falling_from = I_rising ? Q_mag_prev : I_mag;
-                double   rising_mV    = 0.0;
-                double   falling_mV   = falling_from;
-                if ( ps >= RISING_END_PS ) {
-                    rising_mV = rising_to;
-                } else if ( ps >= RISING_START_PS ) {
-                    rising_mV = (ps-RISING_START_PS)/(RISING_END_PS-RISING_START_PS) * rising_to;
-                }
-                if ( ps >= FALLING_END_PS ) {
-                    falling_mV = 0.0;
-                } else if ( ps >= FALLING_START_PS ) {
-                    falling_mV = (1.0 - (ps-FALLING_START_PS)/(FALLING_END_PS-FALLING_START_PS)) * falling_from;
+            uint32_t block_cnt = std::min( SIM_BLOCK_CLK_CNT, clk_cnt - block );
+            {
+                Perf::Scope scope( perf, "generate" );
+                std::vector<std::thread> threads;
+                for( uint32_t t = 0; t < thread_cnt; t++ )
+                {
+                    uint32_t first = block + uint64_t(block_cnt) * t / thread_cnt;
+                    uint32_t last  = block + uint64_t(block_cnt) * (t+1) / thread_cnt;
+                    outs[t].str( "" );
+                    threads.push_back( std::thread( sim_range<N_SQRT>, first, last, std::ref( outs[t] ), std::ref( thread_stats[t] ) ) );
                 }
-                I_mV = I_rising ? rising_mV  : falling_mV;
-                Q_mV = I_rising ? falling_mV : rising_mV;
+                for( auto& thread : threads ) thread.join();
+                scope.count( "clocks", block_cnt );
             }
-
-            double IQ_mV = I_mV + Q_mV;
-            bool   in_eye = IQ_mV > I_min && IQ_mV < I_max;
-            if ( in_eye ) {
-                I_ts_eye_cnt++;
-                if ( I_ts_eye_cnt > I_ts_eye_cnt_max ) I_ts_eye_cnt_max = I_ts_eye_cnt;
-            } else {
-                I_ts_eye_cnt = 0;
+            Perf::Scope scope( perf, "output" );
+            for( uint32_t t = 0; t < thread_cnt; t++ )
+            {
+                std::string str = outs[t].str();
+                out << str;
+                scope.count( "bytes", str.size() );
             }
-            std::string clk_str = (ts == (CLK_TIMESTEP_CNT/2)) ? "  <---- I_clk samples here" :
-                                  (ts == CLK_TIMESTEP_CNT)     ? "  <---- Q_clk samples here" : "";
-            std::cout << (in_eye ? "*" : " ") << "   " << I_mV << " + " << Q_mV << " = " << IQ_mV << clk_str << "\n";
         }
-        double eye_width_ps = double(I_ts_eye_cnt_max) * TIMESTEP_PS;
-        std::cout << "    eye_width=" << eye_width_ps << " ps\n";
-        if ( eye_width_ps < eye_width_ps_min ) eye_width_ps_min = eye_width_ps;
-        if ( eye_width_ps > eye_width_ps_max ) eye_width_ps_max = eye_width_ps;
-        eye_width_ps_tot += eye_width_ps;
-        Q_mag_prev = Q_mag;
-    }
-    double eye_width_ps_avg = eye_width_ps_tot / double(clk_cnt);
-    std::cout << "\neye_width min..max = " << eye_width_ps_min << " ps .. " << eye_width_ps_max << " ps\n";
+        for( const auto& ts : thread_stats )
+        {
+            stats.eye_width_ps_min = std::min( stats.eye_width_ps_min, ts.eye_width_ps_min );
+            stats.eye_width_ps_max = std::max( stats.eye_width_ps_max, ts.eye_width_ps_max );
+            stats.eye_ts_cnt_tot  += ts.eye_ts_cnt_tot;
+        }
+    }
+    {
+        Perf::Scope scope( perf, "output" );
+        if ( out_mode == OutMode::BIN ) {
+            bin_out.close();
+            if ( !bin_out ) { std::cout << "ERROR: could not write " << out_file << "\n"; exit( 1 ); }
+        } else if ( out_mode == OutMode::SP ) {
+            write_sp_deck<N_SQRT>( sp_syms.str() );
+        }
+    }
+    double eye_width_ps_avg = double(stats.eye_ts_cnt_tot) * TIMESTEP_PS / double(clk_cnt);
+    std::cout << "\neye_width min..max = " << stats.eye_width_ps_min << " ps .. " << stats.eye_width_ps_max << " ps\n";
     std::cout << "\neye_width avg      = " << eye_width_ps_avg << " ps\n";
+    if ( !pattern.empty() ) std::cout << "\nexhaustive: every " << pattern_depth << "-symbol pattern once in " << clk_cnt << " clocks\n";
+}
+
+//------------------------------------------------------
+// -lanes: a parallel bus of lane_cnt I+Q lanes, each with its own symbol 
+// stream (lane l's clock i uses random number (l << 32) + i, so lane 0 has 
+// the single-lane symbols), plus crosstalk from the lane on either side:
+//
+//     IQ'[l](t) = IQ[l](t) + sum over a = l-1, l+1 of 
+//                            next_coupling * IQ[a](t) + fext_coupling * (IQ[a](t) - IQ[a](t-1))
+//
+// i.e., near-end crosstalk follows the aggressor's voltage and far-end 
+// crosstalk its slope.  The eye of each lane is make_clk_wave()'s test on IQ'.
+//
+// Each clock, the lanes' waveforms are looked up in the wave table as usual
+// and laid out [timestep][lane] with a zero guard lane at each end, so the 
+// crosstalk and eye-run loop of each timestep, bus_step(), is a branch-free 
+// run over the lanes.  On x86-64 Linux with gcc, it is cloned for AVX-512
+// and AVX2 (the baseline SSE2 can't vectorize it) and the best clone is 
+// picked at load time.
+//------------------------------------------------------
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define BUS_TARGET_CLONES __attribute__((target_clones("avx512f","avx2","default")))
+#else
+#define BUS_TARGET_CLONES
+#endif
+
+BUS_TARGET_CLONES
+void bus_step( uint32_t lanes, const real * cur, const real * prv, real next, real fext, 
+               const real * I_min, const real * I_max, uint32_t * run, uint32_t * run_max )
+{
+    for( uint32_t l = 0; l < lanes; l++ )
+    {
+        real v  = cur[l+1] + next*(cur[l] + cur[l+2]) + fext*((cur[l] - prv[l]) + (cur[l+2] - prv[l+2]));
+        uint32_t in = uint32_t(v > I_min[l]) & uint32_t(v < I_max[l]);
+        run[l]     = (run[l] + 1) * in;
+        run_max[l] = std::max( run_max[l], run[l] );
+    }
+}
+
+template<uint32_t N_SQRT>
+inline uint32_t lane_clk_bits( uint32_t lane, uint64_t i )
+{
+    return rand_n_at( (uint64_t(lane) << 32) + i, N_SQRT*N_SQRT );
+}
+
+template<uint32_t N_SQRT>
+void sim_bus_range( uint32_t first, uint32_t last, std::vector<EyeStats>& stats )
+{
+    const WaveTable<N_SQRT>& wave_table = waves<N_SQRT>();
+    const uint32_t lanes  = lane_cnt;
+    const double   mV_inc = eye_band_mV( N_SQRT );
+    const uint32_t W      = lanes + 2;               // row width with the guard lanes
+    const real     next   = next_coupling;
+    const real     fext   = fext_coupling;
+
+    std::vector<real>     iq( size_t(CLK_TIMESTEP_CNT+1) * W, real(0.0) );    // row 0 is the previous clock's last timestep
+    std::vector<real>     I_min( lanes );
+    std::vector<real>     I_max( lanes );
+    std::vector<uint32_t> run( lanes );
+    std::vector<uint32_t> run_max( lanes );
+    std::vector<uint32_t> Q_level_prev( lanes );
+    for( uint32_t l = 0; l < lanes; l++ )
+    {
+        // regenerate clock first-1 from its counter
+        Q_level_prev[l] = N_SQRT-1;                     // mV_MAX
+        if ( first != 0 ) {
+            uint32_t Q_level_pp = (first == 1) ? N_SQRT-1 : Q_level_of<N_SQRT>( lane_clk_bits<N_SQRT>( l, first-2 ) );
+            uint32_t bits       = lane_clk_bits<N_SQRT>( l, first-1 );
+            const ClkWave& w    = wave_table.wave[Q_level_pp][I_level_of<N_SQRT>( bits )][Q_level_of<N_SQRT>( bits )];
+            iq[l+1]             = w.IQ_mV[CLK_TIMESTEP_CNT-1];
+            Q_level_prev[l]     = Q_level_of<N_SQRT>( bits );
+        }
+    }
+
+    for( uint32_t i = first; i < last; i++ )
+    {
+        for( uint32_t l = 0; l < lanes; l++ )
+        {
+            uint32_t bits    = lane_clk_bits<N_SQRT>( l, i );
+            uint32_t I_level = I_level_of<N_SQRT>( bits );
+            uint32_t Q_level = Q_level_of<N_SQRT>( bits );
+            const ClkWave& w = wave_table.wave[Q_level_prev[l]][I_level][Q_level];
+            for( uint32_t ts = 0; ts < CLK_TIMESTEP_CNT; ts++ ) iq[size_t(ts+1)*W + l+1] = w.IQ_mV[ts];
+            double I_mag = level_mV( N_SQRT, I_level );
+            I_min[l] = (I_mag == -mV_MAX) ? -1000000.0 : (I_mag-mV_inc);
+            I_max[l] = (I_mag ==  mV_MAX) ?  1000000.0 : (I_mag+mV_inc);
+            run[l]     = 0;
+            run_max[l] = 0;
+            Q_level_prev[l] = Q_level;
+        }
+        if ( i == 0 ) std::copy( iq.begin() + W, iq.begin() + 2*W, iq.begin() );     // no slope before the first clock
+
+        for( uint32_t ts = 1; ts <= CLK_TIMESTEP_CNT; ts++ )
+        {
+            bus_step( lanes, &iq[size_t(ts)*W], &iq[size_t(ts-1)*W], next, fext, I_min.data(), I_max.data(), run.data(), run_max.data() );
+        }
+        for( uint32_t l = 0; l < lanes; l++ )
+        {
+            double eye_width_ps = double(run_max[l]) * TIMESTEP_PS;
+            EyeStats& st = stats[l];
+            if ( eye_width_ps < st.eye_width_ps_min ) st.eye_width_ps_min = eye_width_ps;
+            if ( eye_width_ps > st.eye_width_ps_max ) st.eye_width_ps_max = eye_width_ps;
+            st.eye_ts_cnt_tot += run_max[l];
+        }
+        std::copy( iq.end() - W, iq.end(), iq.begin() );
+    }
+}
+
+template<uint32_t N_SQRT>
+void sim_bus( uint32_t clk_cnt )
+{
+    {
+        Perf::Scope scope( perf, "tables" );
+        waves<N_SQRT>();
+        scope.count( "clock_waves", N_SQRT*N_SQRT*N_SQRT );
+    }
+
+    //------------------------------------------------------
+    // Split the clocks across the threads; each regenerates the state 
+    // before its first clock, so the stats are the same for any thread_cnt.
+    //------------------------------------------------------
+    std::vector<std::vector<EyeStats>> thread_stats( thread_cnt, std::vector<EyeStats>( lane_cnt ) );
+    {
+        Perf::Scope scope( perf, "generate" );
+        std::vector<std::thread> threads;
+        for( uint32_t t = 1; t < thread_cnt; t++ )
+        {
+            uint32_t first = uint64_t(clk_cnt) * t / thread_cnt;
+            uint32_t last  = uint64_t(clk_cnt) * (t+1) / thread_cnt;
+            threads.push_back( std::thread( sim_bus_range<N_SQRT>, first, last, std::ref( thread_stats[t] ) ) );
+        }
+        sim_bus_range<N_SQRT>( 0, uint64_t(clk_cnt) / thread_cnt, thread_stats[0] );
+        for( auto& thread : threads ) thread.join();
+        scope.count( "lane_clocks", uint64_t(clk_cnt) * lane_cnt );
+    }
+
+    //------------------------------------------------------
+    // Per-lane and worst-case eye widths.
+    //------------------------------------------------------
+    uint32_t worst_min_lane = 0;
+    uint32_t worst_avg_lane = 0;
+    std::vector<double> eye_width_ps_avg( lane_cnt );
+    std::vector<EyeStats> stats( lane_cnt );
+    for( uint32_t l = 0; l < lane_cnt; l++ )
+    {
+        for( const auto& ts : thread_stats )
+        {
+            stats[l].eye_width_ps_min = std::min( stats[l].eye_width_ps_min, ts[l].eye_width_ps_min );
+            stats[l].eye_width_ps_max = std::max( stats[l].eye_width_ps_max, ts[l].eye_width_ps_max );
+            stats[l].eye_ts_cnt_tot  += ts[l].eye_ts_cnt_tot;
+        }
+        eye_width_ps_avg[l] = double(stats[l].eye_ts_cnt_tot) * TIMESTEP_PS / double(clk_cnt);
+        std::cout << "lane " << l << ": eye_width min..max = " << stats[l].eye_width_ps_min << " ps .. " << stats[l].eye_width_ps_max 
+                  << " ps, avg = " << eye_width_ps_avg[l] << " ps\n";
+        if ( stats[l].eye_width_ps_min < stats[worst_min_lane].eye_width_ps_min ) worst_min_lane = l;
+        if ( eye_width_ps_avg[l] < eye_width_ps_avg[worst_avg_lane] ) worst_avg_lane = l;
+    }
+    std::cout << "\nworst eye_width min = " << stats[worst_min_lane].eye_width_ps_min << " ps (lane " << worst_min_lane << ")\n";
+    std::cout << "\nworst eye_width avg = " << eye_width_ps_avg[worst_avg_lane] << " ps (lane " << worst_avg_lane << ")\n";
+}
+
+//------------------------------------------------------
+// -stat: statistical eye.
+//
+// A clock's waveform depends only on (Q_mag_prev, I_mag, Q_mag), and with 
+// uniformly random symbols each of the N_SQRT^3 combinations has probability 
+// 1/N_SQRT^3.  So rather than simulating clocks, this goes through the wave 
+// table once:
+//
+// - The eye width distribution is exact: the worst and best eye widths of 
+//   any clock, and the probability of each eye width and their average.
+//
+// - With Gaussian noise of RMS stat_noise_mV added at the receiver, the BER 
+//   of an I decision at timestep ts is the probability-weighted sum over the 
+//   combinations of the chance that the noise pushes IQ_mV[ts] outside 
+//   (I_min, I_max), i.e., q_func( margin / noise ) for each side.  That is 
+//   the horizontal bathtub; the vertical one moves all thresholds by an 
+//   offset at the best timestep.  Both go down to any BER without simulating
+//   1/BER clocks.
+//------------------------------------------------------
+template<uint32_t N_SQRT>
+void sim_stat( void )
+{
+    {
+        Perf::Scope scope( perf, "tables" );
+        waves<N_SQRT>();
+        scope.count( "clock_waves", N_SQRT*N_SQRT*N_SQRT );
+    }
+
+    Perf::Scope scope( perf, "stat" );
+    const WaveTable<N_SQRT>& wave_table = waves<N_SQRT>();
+    const double mV_inc = eye_band_mV( N_SQRT );
+    const double p      = 1.0 / double(N_SQRT*N_SQRT*N_SQRT);
+
+    //------------------------------------------------------
+    // Exact eye width distribution.
+    //------------------------------------------------------
+    std::vector<double> eye_ts_p( CLK_TIMESTEP_CNT+1, 0.0 );
+    for( uint32_t qp = 0; qp < N_SQRT; qp++ )
+    {
+        for( uint32_t i = 0; i < N_SQRT; i++ )
+        {
+            for( uint32_t q = 0; q < N_SQRT; q++ ) eye_ts_p[wave_table.wave[qp][i][q].eye_ts_cnt] += p;
+        }
+    }
+    uint32_t eye_ts_min = CLK_TIMESTEP_CNT;
+    uint32_t eye_ts_max = 0;
+    double   eye_ts_avg = 0.0;
+    for( uint32_t ts_cnt = 0; ts_cnt <= CLK_TIMESTEP_CNT; ts_cnt++ )
+    {
+        if ( eye_ts_p[ts_cnt] == 0.0 ) continue;
+        eye_ts_min  = std::min( eye_ts_min, ts_cnt );
+        eye_ts_max  = std::max( eye_ts_max, ts_cnt );
+        eye_ts_avg += eye_ts_p[ts_cnt] * double(ts_cnt);
+        std::cout << "STAT: eye_width=" << double(ts_cnt) * TIMESTEP_PS << " ps probability=" << eye_ts_p[ts_cnt] << "\n";
+    }
+
+    //------------------------------------------------------
+    // BER at timestep ts (0-based) with all thresholds moved up by vt_offset.
+    // The outermost levels have no threshold on their outer side.
+    //------------------------------------------------------
+    auto ber_at = [&]( uint32_t ts, double vt_offset )
+    {
+        double ber = 0.0;
+        for( uint32_t i = 0; i < N_SQRT; i++ )
+        {
+            double I_mag = level_mV( N_SQRT, i );
+            for( uint32_t qp = 0; qp < N_SQRT; qp++ )
+            {
+                for( uint32_t q = 0; q < N_SQRT; q++ )
+                {
+                    double mV = double(wave_table.wave[qp][i][q].IQ_mV[ts]);
+                    if ( i != 0 )        ber += p * q_func( (mV - (I_mag-mV_inc+vt_offset)) / stat_noise_mV );
+                    if ( i != N_SQRT-1 ) ber += p * q_func( ((I_mag+mV_inc+vt_offset) - mV) / stat_noise_mV );
+                }
+            }
+        }
+        return ber;
+    };
+
+    std::vector<double> t_ps( CLK_TIMESTEP_CNT );
+    std::vector<double> t_ber( CLK_TIMESTEP_CNT );
+    uint32_t best_ts = 0;
+    for( uint32_t ts = 0; ts < CLK_TIMESTEP_CNT; ts++ )
+    {
+        t_ps[ts]  = double(ts+1) * TIMESTEP_PS;
+        t_ber[ts] = ber_at( ts, 0.0 );
+        if ( t_ber[ts] < t_ber[best_ts] ) best_ts = ts;
+        std::cout << "BATHTUB: t=" << t_ps[ts] << " ps ber=" << t_ber[ts] << "\n";
+    }
+
+    std::vector<double> vt_mV;
+    std::vector<double> vt_ber;
+    for( double vt_offset = -std::floor( mV_inc / STAT_VT_STEP_mV ) * STAT_VT_STEP_mV; vt_offset <= mV_inc; vt_offset += STAT_VT_STEP_mV )
+    {
+        vt_mV.push_back( vt_offset );
+        vt_ber.push_back( ber_at( best_ts, vt_offset ) );
+        std::cout << "BATHTUB: t=" << t_ps[best_ts] << " ps vt_offset=" << vt_offset << " mV ber=" << vt_ber.back() << "\n";
+    }
+    scope.count( "clock_waves", N_SQRT*N_SQRT*N_SQRT );
+
+    std::cout << "\neye_width min..max = " << double(eye_ts_min) * TIMESTEP_PS << " ps .. " << double(eye_ts_max) * TIMESTEP_PS << " ps\n";
+    std::cout << "\neye_width avg      = " << eye_ts_avg * TIMESTEP_PS << " ps\n";
+    std::cout << "\nnoise = " << stat_noise_mV << " mV RMS, best sampling time = " << t_ps[best_ts] << " ps\n";
+    for( double target : BER_TARGETS )
+    {
+        std::cout << "ber " << target << ": eye_width = " << bathtub_opening( t_ps, t_ber, target ) << " ps, eye_height = " 
+                  << bathtub_opening( vt_mV, vt_ber, target ) << " mV\n";
+    }
 }
@@ -0,0 +1,351 @@
+// Copyright (c) 2014-2019 Robert A. Alfieri
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// qam.h - N-QAM configuration and per-clock I+Q waveforms shared by qam and analyze
+//
+#ifndef _QAM_H
+#define _QAM_H
+
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <type_traits>
+#include "real.h"
+
+// config constants
+static constexpr uint32_t N_SQRT_DEFAULT     = 4;   // sqrt(N) unless chosen at run time; N_SQRT is 2, 4, 8, or 16
+static constexpr double   CLK_GHZ            = 10;  // 10 GHz (half the actual symbol transmit speed)
+static constexpr uint32_t CLK_TIMESTEP_CNT   = 50;  // there are 2 timesteps per CLK_GHZ
+static constexpr double   mV_MAX             = 200; // 200 mV max per clock
+static constexpr bool     USE_SIN_COS        = false;
+static constexpr double   TRANS_START_FRAC   = 0.40; // fraction of half-clock where transition starts
+static constexpr double   TRANS_END_FRAC     = 0.60; // fraction of half-clock where transition ends
+
+// derived constants
+static constexpr uint32_t N_SQRT_MAX         = 16;
+static constexpr uint32_t N_MAX              = N_SQRT_MAX * N_SQRT_MAX;
+static constexpr uint32_t INIT_PHASE_CNT_LG2 = 8;
+static constexpr uint32_t INIT_PHASE_CNT     = 1 << INIT_PHASE_CNT_LG2;
+static constexpr double   PI_DIV_2           = M_PI / 2.0;
+static constexpr double   EPSILON            = 1e-10;
+static constexpr double   CLK_PERIOD_PS      = 1000.0 / CLK_GHZ;
+static constexpr double   TIMESTEP_PS        = CLK_PERIOD_PS / double(CLK_TIMESTEP_CNT);
+static constexpr double   RISING_START_PS    = CLK_PERIOD_PS/2.0 * TRANS_START_FRAC;
+static constexpr double   RISING_END_PS      = CLK_PERIOD_PS/2.0 * TRANS_END_FRAC;
+static constexpr double   FALLING_START_PS   = CLK_PERIOD_PS/2.0 * (1.0-TRANS_END_FRAC);
+static constexpr double   FALLING_END_PS     = CLK_PERIOD_PS/2.0 * (1.0-TRANS_START_FRAC);
+
+//------------------------------------------------------
+// The N-QAM order is a template parameter (N_SQRT magnitudes per I or Q clock), 
+// so each order gets its own tables and sim() with everything below folded as 
+// constants.  qam_dispatch() maps the order chosen at run time to them.
+//------------------------------------------------------
+constexpr bool qam_order_ok( uint32_t n_sqrt )
+{
+    return n_sqrt == 2 || n_sqrt == 4 || n_sqrt == 8 || n_sqrt == 16;
+}
+
+template<typename F> 
+auto qam_dispatch( uint32_t n_sqrt, F f ) 
+{
+    switch( n_sqrt )
+    {
+        case 2:  return f( std::integral_constant<uint32_t, 2>() );
+        case 4:  return f( std::integral_constant<uint32_t, 4>() );
+        case 8:  return f( std::integral_constant<uint32_t, 8>() );
+        default: return f( std::integral_constant<uint32_t, 16>() );
+    }
+}
+
+// magnitude of level 0 .. level_cnt-1, evenly spaced from -mV_MAX to mV_MAX
+constexpr double level_mV( uint32_t level_cnt, uint32_t level )
+{
+    return (level == 0)           ? -mV_MAX :
+           (level == level_cnt-1) ?  mV_MAX :
+                                     double(int(2*level) - int(level_cnt-1)) * mV_MAX / double(level_cnt-1);
+}
+
+// symbol bits per clock
+constexpr uint32_t qam_bit_cnt( uint32_t n_sqrt )
+{
+    return (n_sqrt == 2) ? 2 : (n_sqrt == 4) ? 4 : (n_sqrt == 8) ? 6 : 8;
+}
+
+//------------------------------------------------------
+// I takes the even bits of a symbol and Q the odd bits.  Each is sign-magnitude:
+// its bit 0 is the polarity and the rest is the magnitude (0 is the smallest).
+// For 16-QAM that is bits [0]/[2] for I and [1]/[3] for Q.
+//------------------------------------------------------
+template<uint32_t N_SQRT>
+constexpr uint32_t level_of_code( uint32_t code )
+{
+    return ((code & 1) != 0) ? (N_SQRT/2 + (code >> 1)) : (N_SQRT/2 - 1 - (code >> 1));
+}
+
+constexpr uint32_t odd_even_bits( uint32_t bits, uint32_t first )
+{
+    uint32_t code = 0;
+    for( uint32_t b = first, k = 0; b < 8; b += 2, k++ ) code |= ((bits >> b) & 1) << k;
+    return code;
+}
+
+template<uint32_t N_SQRT> constexpr uint32_t I_level_of( uint32_t bits ) { return level_of_code<N_SQRT>( odd_even_bits( bits, 0 ) ); }
+template<uint32_t N_SQRT> constexpr uint32_t Q_level_of( uint32_t bits ) { return level_of_code<N_SQRT>( odd_even_bits( bits, 1 ) ); }
+
+//------------------------------------------------------
+// The I+Q waveform of one clock depends only on the levels of
+// (Q_mag_prev, I_mag, Q_mag), so all of them are computed ahead of time,
+// along with which timesteps are in the eye and the eye width.
+// sim() then does one lookup per clock instead of CLK_TIMESTEP_CNT evaluations.
+// (With USE_SIN_COS, the compiler must allow sin()/cos() in constant expressions, as gcc does.)
+// The voltages are real (see real.h): the I and Q waveforms are converted from
+// double once per timestep, and their sum and the eye test are done in real.
+//------------------------------------------------------
+struct ClkWave
+{
+    real     I_mV[CLK_TIMESTEP_CNT];
+    real     Q_mV[CLK_TIMESTEP_CNT];
+    real     IQ_mV[CLK_TIMESTEP_CNT];
+    bool     in_eye[CLK_TIMESTEP_CNT];
+    uint32_t eye_ts_cnt;                                // eye width in timesteps
+    double   eye_width_ps;
+};
+
+template<uint32_t N_SQRT>
+struct WaveTable
+{
+    ClkWave  wave[N_SQRT][N_SQRT][N_SQRT];              // [Q_mag_prev][I_mag][Q_mag] levels
+};
+
+//------------------------------------------------------
+// Half-width of the band around I_mag that counts as in the eye.  The 
+// original 4-QAM and 16-QAM model used mV_MAX/3 for both (half the 16-QAM 
+// level spacing), so they keep it; 64-QAM and 256-QAM use half of their 
+// own level spacing, since mV_MAX/3 would span several of their levels.
+//------------------------------------------------------
+constexpr double eye_band_mV( uint32_t n_sqrt )
+{
+    return (n_sqrt <= 4) ? (mV_MAX / 3.0) : (mV_MAX / double(n_sqrt-1));
+}
+
+// mV_inc is eye_band_mV()
+constexpr ClkWave make_clk_wave( double mV_inc, double Q_mag_prev, double I_mag, double Q_mag )
+{
+    ClkWave w{};
+    real     I_min = (I_mag == -mV_MAX) ? -1000000.0 : (I_mag-mV_inc);
+    real     I_max = (I_mag ==  mV_MAX) ?  1000000.0 : (I_mag+mV_inc);
+    uint32_t I_ts_eye_cnt = 0;
+    uint32_t I_ts_eye_cnt_max = 0;
+    for( uint32_t ts = 1; ts <= CLK_TIMESTEP_CNT; ts++ )
+    {
+        double a = double( ts ) * M_PI / double(CLK_TIMESTEP_CNT);
+        double I_mV = 0.0;
+        double Q_mV = 0.0;
+        if ( USE_SIN_COS ) {
+            I_mV = I_mag * sin( a );
+            double Q_mgg = (ts <= CLK_TIMESTEP_CNT/2) ? Q_mag_prev : -Q_mag;
+            Q_mV = Q_mgg * cos( a );
+        } else {
+            //------------------------------------------------------
+            // Sharp Edges
+            //------------------------------------------------------
+            bool     I_rising     = ts <= CLK_TIMESTEP_CNT/2;
+            uint32_t ts_eff       = I_rising ? ts         : (ts - CLK_TIMESTEP_CNT/2);
+            double   ps           = double(ts_eff) * TIMESTEP_PS;
+            double   rising_to    = I_rising ? I_mag      : Q_mag;  
+            double   falling_from = I_rising ? Q_mag_prev : I_mag;
+            double   rising_mV    = 0.0;
+            double   falling_mV   = falling_from;
+            if ( ps >= RISING_END_PS ) {
+                rising_mV = rising_to;
+            } else if ( ps >= RISING_START_PS ) {
+                rising_mV = (ps-RISING_START_PS)/(RISING_END_PS-RISING_START_PS) * rising_to;
+            }
+            if ( ps >= FALLING_END_PS ) {
+                falling_mV = 0.0;
+            } else if ( ps >= FALLING_START_PS ) {
+                falling_mV = (1.0 - (ps-FALLING_START_PS)/(FALLING_END_PS-FALLING_START_PS)) * falling_from;
+            }
+            I_mV = I_rising ? rising_mV  : falling_mV;
+            Q_mV = I_rising ? falling_mV : rising_mV;
+        }
+
+        real   I_mV_r = I_mV;
+        real   Q_mV_r = Q_mV;
+        real   IQ_mV  = I_mV_r + Q_mV_r;
+        bool   in_eye = IQ_mV > I_min && IQ_mV < I_max;
+        if ( in_eye ) {
+            I_ts_eye_cnt++;
+            if ( I_ts_eye_cnt > I_ts_eye_cnt_max ) I_ts_eye_cnt_max = I_ts_eye_cnt;
+        } else {
+            I_ts_eye_cnt = 0;
+        }
+        w.I_mV[ts-1]   = I_mV_r;
+        w.Q_mV[ts-1]   = Q_mV_r;
+        w.IQ_mV[ts-1]  = IQ_mV;
+        w.in_eye[ts-1] = in_eye;
+    }
+    w.eye_ts_cnt   = I_ts_eye_cnt_max;
+    w.eye_width_ps = double(I_ts_eye_cnt_max) * TIMESTEP_PS;
+    return w;
+}
+
+template<uint32_t N_SQRT>
+constexpr void fill_wave_table( WaveTable<N_SQRT>& t )
+{
+    const double mV_inc = eye_band_mV( N_SQRT );
+    for( uint32_t qp = 0; qp < N_SQRT; qp++ )
+    {
+        for( uint32_t i = 0; i < N_SQRT; i++ )
+        {
+            for( uint32_t q = 0; q < N_SQRT; q++ )
+            {
+                t.wave[qp][i][q] = make_clk_wave( mV_inc, level_mV( N_SQRT, qp ), level_mV( N_SQRT, i ), level_mV( N_SQRT, q ) );
+            }
+        }
+    }
+}
+
+template<uint32_t N_SQRT>
+constexpr WaveTable<N_SQRT> make_wave_table( void )
+{
+    WaveTable<N_SQRT> t{};
+    fill_wave_table( t );
+    return t;
+}
+
+//------------------------------------------------------
+// Up to 16-QAM, the table is built at compile time.  The 64-QAM and 256-QAM 
+// tables (512 and 4096 clocks) are beyond the compiler's constexpr limits, 
+// so waves() fills them once at start-up with the same code.
+//------------------------------------------------------
+template<uint32_t N_SQRT> 
+constexpr WaveTable<N_SQRT> WAVES = make_wave_table<N_SQRT>();
+
+template<uint32_t N_SQRT>
+const WaveTable<N_SQRT>& waves( void )
+{
+    if constexpr ( N_SQRT <= 4 ) {
+        return WAVES<N_SQRT>;
+    } else {
+        static WaveTable<N_SQRT> t;
+        static bool filled = (fill_wave_table( t ), true);
+        (void)filled;
+        return t;
+    }
+}
+
+//------------------------------------------------------
+// -out bin file layout (native byte order):
+//
+//     char     magic[4]            "QAMW"
+//     uint32_t version             1
+//     uint32_t N
+//     uint32_t clk_timestep_cnt
+//     double   timestep_ps
+//     double   rising_start_ps, rising_end_ps, falling_start_ps, falling_end_ps
+//     uint32_t use_sin_cos
+//     uint32_t level_cnt
+//     double   level_mV[level_cnt]
+//     uint32_t Q_level_init        level of Q_mag_prev for clock 0
+//     uint64_t clk_cnt
+//     uint8_t  bits[clk_cnt]       one symbol per clock
+//
+// The waveform of each clock follows from the symbols and the timing 
+// parameters exactly as in make_clk_wave().
+//------------------------------------------------------
+static constexpr uint32_t QAM_BIN_VERSION = 1;
+
+template<typename T> void write_bin( std::ostream& out, const T& v ) 
+{ 
+    out.write( reinterpret_cast<const char *>( &v ), sizeof( v ) ); 
+}
+
+template<uint32_t N_SQRT>
+void write_bin_header( std::ostream& out, uint64_t clk_cnt )
+{
+    out.write( "QAMW", 4 );
+    write_bin( out, QAM_BIN_VERSION );
+    write_bin( out, N_SQRT*N_SQRT );
+    write_bin( out, CLK_TIMESTEP_CNT );
+    write_bin( out, TIMESTEP_PS );
+    write_bin( out, RISING_START_PS );
+    write_bin( out, RISING_END_PS );
+    write_bin( out, FALLING_START_PS );
+    write_bin( out, FALLING_END_PS );
+    write_bin( out, uint32_t(USE_SIN_COS) );
+    write_bin( out, N_SQRT );
+    for( uint32_t l = 0; l < N_SQRT; l++ ) write_bin( out, level_mV( N_SQRT, l ) );
+    write_bin( out, N_SQRT-1 );
+    write_bin( out, clk_cnt );
+}
+
+template<typename T> bool read_bin( std::istream& in, T& v ) 
+{ 
+    return bool( in.read( reinterpret_cast<char *>( &v ), sizeof( v ) ) ); 
+}
+
+//------------------------------------------------------
+// Read a whole -out bin file, including its order (n_sqrt).
+// Returns "" on success, else what is wrong with it.  The timing parameters
+// and levels must match the ones compiled in here, otherwise WAVES would not
+// reproduce the waveform qam wrote.
+//------------------------------------------------------
+inline std::string read_qam_bin( std::string path, std::vector<uint8_t>& syms, uint32_t& n_sqrt, uint32_t& Q_level_init )
+{
+    std::ifstream in( path, std::ios::binary );
+    if ( !in.is_open() ) return "could not open " + path;
+    char magic[4];
+    uint32_t version, n, clk_timestep_cnt, use_sin_cos, level_cnt;
+    double   timestep_ps, rising_start_ps, rising_end_ps, falling_start_ps, falling_end_ps;
+    uint64_t clk_cnt;
+    if ( !in.read( magic, 4 ) || std::string( magic, 4 ) != "QAMW" ) return path + " is not a qam -out bin file";
+    if ( !read_bin( in, version ) || version != QAM_BIN_VERSION ) return path + " has an unsupported version";
+    if ( !read_bin( in, n ) || !read_bin( in, clk_timestep_cnt ) || !read_bin( in, timestep_ps ) ||
+         !read_bin( in, rising_start_ps ) || !read_bin( in, rising_end_ps ) || 
+         !read_bin( in, falling_start_ps ) || !read_bin( in, falling_end_ps ) ||
+         !read_bin( in, use_sin_cos ) || !read_bin( in, level_cnt ) ) return "truncated header in " + path;
+    n_sqrt = level_cnt;
+    if ( !qam_order_ok( n_sqrt ) || n != n_sqrt*n_sqrt ) return path + " has an unsupported QAM order";
+    bool same = clk_timestep_cnt == CLK_TIMESTEP_CNT && timestep_ps == TIMESTEP_PS &&
+                rising_start_ps == RISING_START_PS && rising_end_ps == RISING_END_PS &&
+                falling_start_ps == FALLING_START_PS && falling_end_ps == FALLING_END_PS &&
+                (use_sin_cos != 0) == USE_SIN_COS;
+    for( uint32_t l = 0; same && l < n_sqrt; l++ )
+    {
+        double mV;
+        if ( !read_bin( in, mV ) ) return "truncated header in " + path;
+        same = mV == level_mV( n_sqrt, l );
+    }
+    if ( !same ) return path + " was written by a qam with different waveform constants";
+    if ( !read_bin( in, Q_level_init ) || Q_level_init >= n_sqrt || !read_bin( in, clk_cnt ) ) return "truncated header in " + path;
+    syms.resize( clk_cnt );
+    if ( clk_cnt != 0 && !in.read( reinterpret_cast<char *>( syms.data() ), clk_cnt ) ) return "truncated symbols in " + path;
+    for( auto bits : syms ) 
+    {
+        if ( bits >= n ) return "bad symbol in " + path;
+    }
+    return "";
+}
+
+#endif
@@ -0,0 +1,151 @@
+// Copyright (c) 2014-2019 Robert A. Alfieri
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// real.h - numeric type of waveform voltages in qam and analyze: double, float, or fixed point
+//
+// The doit scripts pick it with preprocessor flags:
+//
+//   -DFIXED_USE_FLOAT      float: half the memory and twice the SIMD lanes of double
+//   -DFIXED_USE_DOUBLE     double (what the doit scripts pass by default)
+//   neither                Fixed<FIXED_INT_W, FIXED_FRAC_W>, a signed Q-format value 
+//                          with the resolution of the RX ADC and comparators
+//
+// FIXED_USE_FLOAT wins if both are given.  Times stay double in all cases.
+//
+// real_store is how long arrays of them are kept: the same as real, except 
+// that a Fixed that fits in 16 bits is kept as a Fixed16.
+//
+#ifndef _REAL_H
+#define _REAL_H
+
+#include <cstdint>
+#include <ostream>
+#include <type_traits>
+
+#ifndef FIXED_INT_W
+#define FIXED_INT_W  11                         // integer bits of mV, not counting the sign: +/- 2048 mV
+#endif
+#ifndef FIXED_FRAC_W
+#define FIXED_FRAC_W 4                          // fraction bits of mV: 1/16 mV resolution
+#endif
+
+//------------------------------------------------------
+// Signed fixed point with INT_W integer bits and FRAC_W fraction bits in an int32_t.
+// Conversion from double rounds to nearest and saturates, as an ADC does.
+// Sums and differences are plain int32_t arithmetic so that the slicers 
+// vectorize; mV values are far from the range limits.  Products and 
+// quotients round to nearest through an int64_t and saturate.
+// Everything is constexpr so that the qam wave tables can still be built at compile time.
+//------------------------------------------------------
+template<uint32_t INT_W, uint32_t FRAC_W>
+class Fixed
+{
+public:
+    static_assert( 1 + INT_W + FRAC_W <= 32, "Fixed must fit in an int32_t" );
+
+    static constexpr int64_t ONE     = int64_t(1) << FRAC_W;
+    static constexpr int64_t RAW_MAX = (int64_t(1) << (INT_W + FRAC_W)) - 1;
+    static constexpr int64_t RAW_MIN = -RAW_MAX - 1;
+
+    constexpr Fixed( void ) : v( 0 ) {}
+    constexpr Fixed( double d ) : v( int32_t( saturate( round_half_away( d * double(ONE) ) ) ) ) {}
+
+    static constexpr Fixed from_raw( int64_t raw ) { Fixed f; f.v = int32_t( saturate( raw ) ); return f; }
+    constexpr int32_t      raw( void ) const       { return v; }
+    constexpr explicit operator double( void ) const { return double(v) / double(ONE); }
+    constexpr explicit operator int( void ) const    { return int( double(*this) ); }
+
+    constexpr Fixed operator - ( void ) const { return raw_fixed( -v ); }
+    friend constexpr Fixed operator + ( Fixed a, Fixed b ) { return raw_fixed( a.v + b.v ); }
+    friend constexpr Fixed operator - ( Fixed a, Fixed b ) { return raw_fixed( a.v - b.v ); }
+    friend constexpr Fixed operator * ( Fixed a, Fixed b ) { return from_raw( div_round( int64_t(a.v) * int64_t(b.v), ONE ) ); }
+    friend constexpr Fixed operator / ( Fixed a, Fixed b ) { return from_raw( div_round( int64_t(a.v) * ONE, int64_t(b.v) ) ); }
+    constexpr Fixed& operator += ( Fixed b ) { return *this = *this + b; }
+    constexpr Fixed& operator -= ( Fixed b ) { return *this = *this - b; }
+    constexpr Fixed& operator *= ( Fixed b ) { return *this = *this * b; }
+    constexpr Fixed& operator /= ( Fixed b ) { return *this = *this / b; }
+
+    friend constexpr bool operator == ( Fixed a, Fixed b ) { return a.v == b.v; }
+    friend constexpr bool operator != ( Fixed a, Fixed b ) { return a.v != b.v; }
+    friend constexpr bool operator <  ( Fixed a, Fixed b ) { return a.v <  b.v; }
+    friend constexpr bool operator <= ( Fixed a, Fixed b ) { return a.v <= b.v; }
+    friend constexpr bool operator >  ( Fixed a, Fixed b ) { return a.v >  b.v; }
+    friend constexpr bool operator >= ( Fixed a, Fixed b ) { return a.v >= b.v; }
+
+    friend std::ostream& operator << ( std::ostream& out, Fixed a ) { return out << double(a); }
+
+private:
+    int32_t v;
+
+    static constexpr Fixed raw_fixed( int32_t raw ) { Fixed f; f.v = raw; return f; }
+
+    static constexpr int64_t saturate( int64_t raw )      { return (raw > RAW_MAX) ? RAW_MAX : (raw < RAW_MIN) ? RAW_MIN : raw; }
+    static constexpr int64_t round_half_away( double d )  
+    { 
+        // also saturates doubles that are beyond int64_t
+        return (d >=  double(RAW_MAX)) ? RAW_MAX : 
+               (d <=  double(RAW_MIN)) ? RAW_MIN : 
+               (d < 0.0) ? -int64_t(-d + 0.5) : int64_t(d + 0.5); 
+    }
+    static constexpr int64_t div_round( int64_t n, int64_t d )
+    {
+        if ( d == 0 ) return (n < 0) ? RAW_MIN : RAW_MAX;
+        if ( d < 0 ) { n = -n; d = -d; }
+        return (n < 0) ? -((-n + d/2) / d) : ((n + d/2) / d);
+    }
+};
+
+//------------------------------------------------------
+// 16-bit storage for a Fixed<INT_W, FRAC_W>.  It converts to and from 
+// the Fixed without rounding; arithmetic is done on the Fixed.
+//------------------------------------------------------
+template<uint32_t INT_W, uint32_t FRAC_W>
+class Fixed16
+{
+public:
+    static_assert( 1 + INT_W + FRAC_W <= 16, "Fixed16 must fit in an int16_t" );
+
+    constexpr Fixed16( void ) : v( 0 ) {}
+    constexpr Fixed16( Fixed<INT_W, FRAC_W> f ) : v( int16_t( f.raw() ) ) {}
+
+    constexpr operator Fixed<INT_W, FRAC_W>( void ) const { return Fixed<INT_W, FRAC_W>::from_raw( v ); }
+    constexpr explicit operator double( void ) const      { return double( Fixed<INT_W, FRAC_W>( *this ) ); }
+    constexpr explicit operator int( void ) const         { return int( Fixed<INT_W, FRAC_W>( *this ) ); }
+
+private:
+    int16_t v;
+};
+
+template<typename R> struct RealStore { using type = R; };
+template<uint32_t INT_W, uint32_t FRAC_W> struct RealStore<Fixed<INT_W, FRAC_W>> 
+{ 
+    using type = typename std::conditional<1 + INT_W + FRAC_W <= 16, Fixed16<INT_W, FRAC_W>, Fixed<INT_W, FRAC_W>>::type;
+};
+
+#if defined(FIXED_USE_FLOAT)
+using real = float;
+#elif defined(FIXED_USE_DOUBLE)
+using real = double;
+#else
+using real = Fixed<FIXED_INT_W, FIXED_FRAC_W>;
+#endif
+using real_store = RealStore<real>::type;
+
+#endif